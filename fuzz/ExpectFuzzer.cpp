@@ -0,0 +1,33 @@
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "DHCP.h"
+#include "Expect.h"
+
+// The first line of the input is a rule, the rest is a reply's options.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	std::span<const uint8_t> input{data, size};
+	size_t newline = 0;
+	while (newline < input.size() && input[newline] != '\n')
+		++newline;
+
+	std::vector<std::string> rules{std::string(input.begin(), input.begin() + static_cast<std::ptrdiff_t>(newline))};
+	auto expectations = ExpectProgram::Compile(rules);
+	if (!expectations)
+		return 0;
+
+	std::span<const uint8_t> options = input.subspan(std::min(newline + 1, input.size()));
+	size_t failed = expectations->Evaluate(options);
+	if (failed > 1)
+		__builtin_trap();
+
+	std::ostringstream report;
+	expectations->Report(report);
+
+	return 0;
+}
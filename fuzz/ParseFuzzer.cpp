@@ -0,0 +1,55 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <vector>
+
+#include "DHCP.h"
+#include "DHCPv6.h"
+#include "Expect.h"
+
+// Feed arbitrary datagrams through the same path replies take in main():
+// the header check, the option walk and the expectation table, for both
+// DHCPv4 and DHCPv6.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	static ExpectProgram expectations = *ExpectProgram::Compile({
+		"53=2", "!252", "121", "51>=3600", "6~10.0.0.53", "55~3", "15='lan'", "61!=0x01"
+	});
+
+	std::span<const uint8_t> datagram{data, size};
+	std::span<const uint8_t> options = GetDHCPOptions(datagram);
+
+	// Print the reply the way main() does, without filling the terminal.
+	static FILE *null = fopen("/dev/null", "w");
+	PrintDHCPPacket(null, datagram);
+
+	// Touch every byte the walk hands us so ASan sees any overrun.
+	volatile uint8_t sink = 0;
+	DHCPOptionScratch joined;
+	WalkLongDHCPOptions(options, joined, [&sink](uint8_t code, std::span<const uint8_t> optdata) {
+		sink = sink ^ code;
+		for (uint8_t byte : optdata)
+			sink = sink ^ byte;
+	});
+
+	expectations.Evaluate(options);
+
+	static ExpectProgram expectations6 = *ExpectProgram::Compile({
+		"1", "2", "!14", "23~2001:4860:4860::8888", "7>=10", "25", "5", "26", "!13>0"
+	}, AF_INET6);
+
+	std::span<const uint8_t> options6 = GetDHCPv6Options(datagram);
+	PrintDHCPv6Options(null, options6);
+
+	// Nested options are walked the same way the expectations see them.
+	WalkNestedDHCPv6Options(options6, [&sink](uint16_t code, std::span<const uint8_t> optdata) {
+		sink = sink ^ static_cast<uint8_t>(code);
+		for (uint8_t byte : optdata)
+			sink = sink ^ byte;
+	});
+
+	expectations6.EvaluateV6(options6);
+
+	return 0;
+}
@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "DHCP.h"
+
+/**
+ * Property test for the builder and the parser: any set of options added
+ * to a DHCPPayload must come back out of WalkLongDHCPOptions unchanged,
+ * with options added more than once under the same code joined together
+ * as a receiver does (RFC 3396).
+ *
+ * The input is the xid followed by options encoded as code, a 16 bit
+ * length and data, so the fuzzer can reach options longer than 255 bytes.
+ */
+using OptionList = std::vector<std::pair<uint8_t, std::vector<uint8_t>>>;
+
+// Every part of an option is appended to the first one with the same code.
+static void Append(OptionList &list, uint8_t code, std::span<const uint8_t> data)
+{
+	auto it = std::ranges::find(list, code, &OptionList::value_type::first);
+	if (it == list.end())
+		it = list.emplace(list.end(), code, std::vector<uint8_t>{});
+	it->second.insert(it->second.end(), data.begin(), data.end());
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	std::span<const uint8_t> input{data, size};
+
+	uint32_t xid = 0;
+	if (input.size() < sizeof(xid))
+		return 0;
+	memcpy(&xid, input.data(), sizeof(xid));
+	input = input.subspan(sizeof(xid));
+
+	DHCPPayload payload;
+	payload.GetDHCPPakcetStructure()->xid = xid;
+
+	OptionList expected;
+	while (input.size() >= 3)
+	{
+		uint8_t code = input[0];
+		size_t length = static_cast<size_t>(input[1]) << 8 | input[2];
+		input = input.subspan(3);
+
+		// Pad and end carry no data so they can't be added as options.
+		if (code == 0x00 || code == 0xFF)
+			continue;
+
+		std::span<const uint8_t> optdata = input.first(std::min(length, input.size()));
+		input = input.subspan(optdata.size());
+
+		payload.AddOption(code, optdata);
+		Append(expected, code, optdata);
+	}
+
+	std::vector<uint8_t> datagram = std::move(payload.GetStructureData());
+
+	if (datagram.size() < sizeof(struct DHCPPacket))
+		__builtin_trap();
+
+	const struct DHCPPacket *packet = reinterpret_cast<const struct DHCPPacket*>(datagram.data());
+	if (packet->xid != xid || packet->cookie != DHCP_COOKIE || packet->op != BOOTREQUEST)
+		__builtin_trap();
+
+	OptionList parsed;
+	DHCPOptionScratch joined;
+	bool valid = WalkLongDHCPOptions(GetDHCPOptions(datagram), joined, [&parsed](uint8_t code, std::span<const uint8_t> optdata) {
+		parsed.emplace_back(code, std::vector<uint8_t>(optdata.begin(), optdata.end()));
+	});
+
+	if (!valid || parsed != expected)
+		__builtin_trap();
+
+	return 0;
+}
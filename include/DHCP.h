@@ -1,8 +1,14 @@
 #pragma once
+#include <array>
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <vector>
 #include <ranges>
-#include "DHCP.h"
+#include <span>
+#include <utility>
 
 // Always set to 99.130.83.99
 #define DHCP_COOKIE 0x63538263
@@ -127,30 +133,30 @@ class DHCPPayload
 	// The actual data structure.
 	std::vector<uint8_t> structuredata_;
 
-	// The DHCP packet structure at the front of the above array.
-	struct DHCPPacket *packet_;
-
-	// a list of options instantiated inside this structure
-	std::vector<struct DHCPOption*> options_;
+	// Offsets of the options instantiated inside this structure. These are
+	// offsets rather than pointers since the vector moves when it grows.
+	std::vector<size_t> options_;
 
 public:
 	DHCPPayload()
 	{
 		// Allocate the packet structure.
 		structuredata_.resize(sizeof(struct DHCPPacket));
-		this->packet_ = reinterpret_cast<struct DHCPPacket*>(this->structuredata_.data());
 
 		// Set some basic data we're almost always going to have.
-		this->packet_->op = BOOTREQUEST;
-		this->packet_->htype = 0x1; // Ethernet hardware type.
-		this->packet_->cookie = DHCP_COOKIE;
+		struct DHCPPacket *packet = this->GetDHCPPakcetStructure();
+		packet->op = BOOTREQUEST;
+		packet->htype = 0x1; // Ethernet hardware type.
+		packet->cookie = DHCP_COOKIE;
 	}
 
 	// Not copyable
 	DHCPPayload(const DHCPPayload &) = delete;
 	DHCPPayload &operator=(const DHCPPayload &) = delete;
 
-	struct DHCPPacket *GetDHCPPakcetStructure() { return this->packet_; }
+	// The DHCP packet structure at the front of the data. Adding options can
+	// reallocate the data so don't hold on to this across AddOption calls.
+	struct DHCPPacket *GetDHCPPakcetStructure() { return reinterpret_cast<struct DHCPPacket*>(this->structuredata_.data()); }
 
 	// This returns the structured data and resets the structure.
 	std::vector<uint8_t> &&GetStructureData()
@@ -166,42 +172,144 @@ public:
 		requires std::convertible_to<std::ranges::range_value_t<std::remove_cvref_t<Range>>, uint8_t>
 	void AddOption(uint8_t id, Range &&data)
 	{
-		size_t length = std::ranges::size(data);
-		const auto *ptr = std::ranges::cdata(data);
-
-		// Because we got a pointer to the end of the data, we now need to 
-		// allocate space inside the vector for the structure we're about to add.
-		this->structuredata_.resize(this->structuredata_.size() + sizeof(struct DHCPOption) + length);
-
-		// Get a pointer to the structure.
-struct DHCPOption *opt = reinterpret_cast<struct DHCPOption*>(this->structuredata_.data() + this->structuredata_.size() - (length + sizeof(struct DHCPOption) - 1));
-
-		// Now we can set the values.
-		opt->option_id = id;
-		opt->option_len = static_cast<decltype(opt->option_len)>(length);
-		memcpy(opt->data, ptr, opt->option_len);
-
-		// Add the option to the option array for later.
-		this->options_.emplace_back(opt);
+		std::span<const uint8_t> remaining{reinterpret_cast<const uint8_t*>(std::ranges::cdata(data)), std::ranges::size(data)};
+
+		// The length field is a single byte, so anything longer than 255 bytes
+		// is split into consecutive options with the same code which the
+		// receiver concatenates back together (RFC 3396).
+		do
+		{
+			size_t length = std::min<size_t>(remaining.size(), 0xFF);
+			size_t offset = this->structuredata_.size();
+
+			// Start by getting the size of a structure (3 bytes) we subtract
+			// 1 because `uint8_t data[1]` is part of the option data.
+			this->structuredata_.resize(offset + sizeof(struct DHCPOption) - 1 + length);
+
+			// Get a pointer to the structure.
+			struct DHCPOption *opt = reinterpret_cast<struct DHCPOption*>(this->structuredata_.data() + offset);
+
+			// Now we can set the values.
+			opt->option_id = id;
+			opt->option_len = static_cast<decltype(opt->option_len)>(length);
+			if (length)
+				memcpy(this->structuredata_.data() + offset + offsetof(struct DHCPOption, data), remaining.data(), length);
+
+			// Add the option to the option array for later.
+			this->options_.emplace_back(offset);
+			remaining = remaining.subspan(length);
+		} while (!remaining.empty());
 	}
 
 	void AddOption(uint8_t id, uint8_t type)
 	{
-		// Because we got a pointer to the end of the data, we now need to 
-		// allocate space inside the vector for the structure we're about to add.
-		this->structuredata_.resize(this->structuredata_.size() + sizeof(struct DHCPOption));
+		this->AddOption(id, std::array<uint8_t, 1>{type});
+	}
+};
 
-		// Get a pointer to the structure.
-		struct DHCPOption *opt = reinterpret_cast<struct DHCPOption*>(this->structuredata_.data() + this->structuredata_.size() - sizeof(struct DHCPOption));
+// Returns the options area which follows the fixed DHCP header and magic
+// cookie, or an empty span if the datagram is too short to be DHCP at all.
+constexpr std::span<const uint8_t> GetDHCPOptions(std::span<const uint8_t> datagram) noexcept
+{
+	if (datagram.size() < sizeof(struct DHCPPacket))
+		return {};
+	return datagram.subspan(sizeof(struct DHCPPacket));
+}
+
+/**
+ * Walk the options area of a DHCP packet, calling fn(code, data) for every
+ * option found. Pad options are skipped and the walk stops at the end option.
+ * Every length is checked against the buffer, so this is safe to call on
+ * anything received from the wire; false is returned if an option would run
+ * past the end of the buffer.
+ */
+template <typename Function>
+constexpr bool WalkDHCPOptions(std::span<const uint8_t> options, Function &&fn)
+{
+	size_t i = 0;
+	while (i < options.size())
+	{
+		uint8_t code = options[i++];
 
-		printf("New structure size %d\n", this->structuredata_.size());
+		if (code == 0x00)
+			continue;
+		if (code == 0xFF)
+			return true;
 
-		// Now we can set the values.
-		opt->option_id = id;
-		opt->option_len = 1;
-		opt->data[0] = type;
+		if (i >= options.size())
+			return false;
 
-		// Add the option to the option array for later.
-		this->options_.emplace_back(opt);
+		size_t length = options[i++];
+		if (length > options.size() - i)
+			return false;
+
+		fn(code, options.subspan(i, length));
+		i += length;
 	}
+
+	// Some servers forget the end option, don't punish them for it.
+	return true;
+}
+
+// Reusable storage for WalkLongDHCPOptions, so joining split options
+// stops allocating once it has seen a few replies.
+struct DHCPOptionScratch
+{
+	// Every part after the first of options which appear more than once.
+	std::vector<std::pair<uint8_t, std::span<const uint8_t>>> parts;
+	// Where those options are joined back together.
+	std::vector<uint8_t> joined;
 };
+
+/**
+ * Like WalkDHCPOptions, but an option which was split over several options
+ * with the same code (RFC 3396) is concatenated back together and passed
+ * to fn once, in the order the first parts appeared. The buffer is only
+ * walked once: each option is recorded as it is found and fn is called
+ * after the walk. Joined data lives in `scratch`, so it is only valid for
+ * the duration of the call. Options before a malformed one are still
+ * passed on.
+ */
+template <typename Function>
+bool WalkLongDHCPOptions(std::span<const uint8_t> options, DHCPOptionScratch &scratch, Function &&fn)
+{
+	// There are at most 254 distinct codes once pad and end are left out.
+	std::array<std::span<const uint8_t>, 256> first{};
+	std::array<uint32_t, 256> count{};
+	std::array<uint8_t, 256> order;
+	size_t distinct = 0;
+
+	scratch.parts.clear();
+	bool valid = WalkDHCPOptions(options, [&](uint8_t code, std::span<const uint8_t> data) {
+		if (count[code]++ == 0)
+		{
+			first[code] = data;
+			order[distinct++] = code;
+		}
+		else
+			scratch.parts.emplace_back(code, data);
+	});
+
+	for (size_t i = 0; i < distinct; ++i)
+	{
+		uint8_t code = order[i];
+		if (count[code] == 1)
+		{
+			fn(code, first[code]);
+			continue;
+		}
+
+		scratch.joined.assign(first[code].begin(), first[code].end());
+		for (const auto &[other, part] : scratch.parts)
+			if (other == code)
+				scratch.joined.insert(scratch.joined.end(), part.begin(), part.end());
+		fn(code, std::span<const uint8_t>(scratch.joined));
+	}
+
+	return valid;
+}
+
+// Print the header and options of a DHCP packet received from the network.
+// Returns false if it is too short or has a malformed option, anything
+// before the malformed option is still printed.
+bool PrintDHCPPacket(FILE *out, std::span<const uint8_t> datagram);
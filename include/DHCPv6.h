@@ -0,0 +1,272 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <ranges>
+#include <span>
+#include <type_traits>
+#include <netinet/in.h>
+
+// UDP ports used by clients and servers/relays (RFC 8415 section 7.2)
+#define DHCPV6_CLIENT_PORT 546
+#define DHCPV6_SERVER_PORT 547
+
+// All_DHCP_Relay_Agents_and_Servers, ff02::1:2
+constexpr struct in6_addr DHCPV6_ALL_SERVERS = {{{0xFF, 0x02, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01, 0, 0x02}}};
+
+/**
+   Message             Use
+   -------             ---
+
+   SOLICIT             Client multicast to locate servers.
+
+   ADVERTISE           Server to client in response to SOLICIT, indicating
+                       it is available for service.
+
+   REQUEST             Client to a specific server requesting
+                       configuration parameters, including addresses
+                       and/or delegated prefixes.
+
+   REPLY               Server to client containing assigned addresses,
+                       delegated prefixes and configuration parameters in
+                       response to SOLICIT (rapid commit), REQUEST, RENEW,
+                       REBIND or INFORMATION-REQUEST.
+
+   INFORMATION-REQUEST Client to server, asking only for configuration
+                       parameters without any addresses or prefixes.
+ */
+
+enum DHCPv6MessageType : uint8_t
+{
+	DHCPV6_SOLICIT = 1,
+	DHCPV6_ADVERTISE,
+	DHCPV6_REQUEST,
+	DHCPV6_CONFIRM,
+	DHCPV6_RENEW,
+	DHCPV6_REBIND,
+	DHCPV6_REPLY,
+	DHCPV6_RELEASE,
+	DHCPV6_DECLINE,
+	DHCPV6_RECONFIGURE,
+	DHCPV6_INFORMATION_REQUEST,
+	DHCPV6_RELAY_FORW,
+	DHCPV6_RELAY_REPL
+};
+
+// Option codes we build or decode ourselves (RFC 8415 section 21)
+enum DHCPv6OptionCode : uint16_t
+{
+	OPTION_CLIENTID = 1,
+	OPTION_SERVERID = 2,
+	OPTION_IA_NA = 3,
+	OPTION_IA_TA = 4,
+	OPTION_IAADDR = 5,
+	OPTION_ORO = 6,
+	OPTION_PREFERENCE = 7,
+	OPTION_ELAPSED_TIME = 8,
+	OPTION_STATUS_CODE = 13,
+	OPTION_RAPID_COMMIT = 14,
+	OPTION_DNS_SERVERS = 23,
+	OPTION_DOMAIN_LIST = 24,
+	OPTION_IA_PD = 25,
+	OPTION_IAPREFIX = 26
+};
+
+/**
+   msg-type        1  Identifies the DHCP message type.
+   transaction-id  3  The transaction ID for this message exchange.
+   options       var  Options carried in this message, each one a
+                      2 byte code, a 2 byte length and the data, all
+                      in network byte order.
+*/
+
+struct DHCPv6Packet
+{
+	uint8_t msg_type;
+	uint8_t xid[3];
+	// After this comes the options.
+};
+
+// IA_NA and IA_PD both start with the IAID, T1 and T2 before their own options.
+#define DHCPV6_IA_HEADER_LEN 12
+
+constexpr uint32_t GetDHCPv6TransactionID(const struct DHCPv6Packet *packet) noexcept
+{
+	return static_cast<uint32_t>(packet->xid[0]) << 16 | static_cast<uint32_t>(packet->xid[1]) << 8 | packet->xid[2];
+}
+
+constexpr void SetDHCPv6TransactionID(struct DHCPv6Packet *packet, uint32_t xid) noexcept
+{
+	packet->xid[0] = static_cast<uint8_t>(xid >> 16);
+	packet->xid[1] = static_cast<uint8_t>(xid >> 8);
+	packet->xid[2] = static_cast<uint8_t>(xid);
+}
+
+// Build the IAID, T1 and T2 header of an IA_NA or IA_PD. Leaving T1 and T2
+// at zero lets the server pick.
+constexpr std::array<uint8_t, DHCPV6_IA_HEADER_LEN> DHCPv6IA(uint32_t iaid) noexcept
+{
+	return {static_cast<uint8_t>(iaid >> 24), static_cast<uint8_t>(iaid >> 16),
+		static_cast<uint8_t>(iaid >> 8), static_cast<uint8_t>(iaid)};
+}
+
+// Build a DUID-LL (type 3) for an ethernet interface from its MAC address.
+constexpr std::array<uint8_t, 10> DHCPv6DUIDLL(const std::array<uint8_t, 6> &mac) noexcept
+{
+	return {0x00, 0x03, 0x00, 0x01, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]};
+}
+
+class DHCPv6Payload
+{
+	// The actual data structure.
+	std::vector<uint8_t> structuredata_;
+
+public:
+	DHCPv6Payload(DHCPv6MessageType type, uint32_t xid)
+	{
+		// Allocate the packet structure.
+		structuredata_.resize(sizeof(struct DHCPv6Packet));
+
+		struct DHCPv6Packet *packet = this->GetDHCPv6PacketStructure();
+		packet->msg_type = type;
+		SetDHCPv6TransactionID(packet, xid);
+	}
+
+	// Not copyable
+	DHCPv6Payload(const DHCPv6Payload &) = delete;
+	DHCPv6Payload &operator=(const DHCPv6Payload &) = delete;
+
+	// The DHCPv6 header at the front of the data. Adding options can
+	// reallocate the data so don't hold on to this across AddOption calls.
+	struct DHCPv6Packet *GetDHCPv6PacketStructure() { return reinterpret_cast<struct DHCPv6Packet*>(this->structuredata_.data()); }
+
+	// This returns the structured data and resets the structure.
+	std::vector<uint8_t> &&GetStructureData()
+	{
+		// DHCPv6 has no end option, the datagram length is all we get.
+		return std::move(this->structuredata_);
+	}
+
+	// Append a TLV-16 option. Returns false if the data cannot fit in one option.
+	template <std::ranges::range Range>
+		requires std::convertible_to<std::ranges::range_value_t<std::remove_cvref_t<Range>>, uint8_t>
+	bool AddOption(uint16_t code, Range &&data)
+	{
+		size_t length = std::ranges::size(data);
+		if (length > 0xFFFF)
+			return false;
+
+		size_t offset = this->structuredata_.size();
+		this->structuredata_.resize(offset + 4 + length);
+
+		uint8_t *opt = this->structuredata_.data() + offset;
+		opt[0] = static_cast<uint8_t>(code >> 8);
+		opt[1] = static_cast<uint8_t>(code);
+		opt[2] = static_cast<uint8_t>(length >> 8);
+		opt[3] = static_cast<uint8_t>(length);
+		if (length)
+			memcpy(opt + 4, std::ranges::cdata(data), length);
+
+		return true;
+	}
+};
+
+// Returns the options which follow the DHCPv6 header, or an empty span if
+// the datagram is too short to be DHCPv6 at all.
+constexpr std::span<const uint8_t> GetDHCPv6Options(std::span<const uint8_t> datagram) noexcept
+{
+	if (datagram.size() < sizeof(struct DHCPv6Packet))
+		return {};
+	return datagram.subspan(sizeof(struct DHCPv6Packet));
+}
+
+/**
+ * The DHCPv6 counterpart of WalkDHCPOptions, calling fn(code, data) for
+ * every TLV-16 option in the buffer. This works for the top level options
+ * as well as the options nested inside IA_NA, IA_PD and friends. Returns
+ * false if an option would run past the end of the buffer.
+ */
+template <typename Function>
+constexpr bool WalkDHCPv6Options(std::span<const uint8_t> options, Function &&fn)
+{
+	size_t i = 0;
+	while (i < options.size())
+	{
+		if (options.size() - i < 4)
+			return false;
+
+		uint16_t code = static_cast<uint16_t>(options[i] << 8 | options[i + 1]);
+		size_t length = static_cast<size_t>(options[i + 2] << 8 | options[i + 3]);
+		i += 4;
+
+		if (length > options.size() - i)
+			return false;
+
+		fn(code, options.subspan(i, length));
+		i += length;
+	}
+
+	return true;
+}
+
+// Where the options carried inside an option start, or zero for options
+// which don't carry any.
+constexpr size_t DHCPv6NestedOffset(uint16_t code) noexcept
+{
+	switch (code)
+	{
+		case OPTION_IA_NA:
+		case OPTION_IA_PD:
+			return DHCPV6_IA_HEADER_LEN;
+		case OPTION_IA_TA:
+			// IAID only
+			return 4;
+		case OPTION_IAADDR:
+			// address, preferred lifetime, valid lifetime
+			return sizeof(struct in6_addr) + 8;
+		case OPTION_IAPREFIX:
+			// preferred lifetime, valid lifetime, prefix length, prefix
+			return 9 + sizeof(struct in6_addr);
+		default:
+			return 0;
+	}
+}
+
+/**
+ * WalkDHCPv6Options, but also descending into the options nested inside
+ * IA_NA, IA_TA and IA_PD and the addresses and prefixes inside those, so
+ * fn sees every IAADDR, IAPREFIX and per-IA status code. Nested options
+ * are passed right after the option carrying them, and fn can take a
+ * third argument for how deeply they are nested. Returns false if any
+ * level is malformed.
+ */
+template <typename Function>
+constexpr bool WalkNestedDHCPv6Options(std::span<const uint8_t> options, Function &&fn, unsigned depth = 0)
+{
+	bool nested = true;
+	bool valid = WalkDHCPv6Options(options, [&fn, &nested, depth](uint16_t code, std::span<const uint8_t> data) {
+		// fn may also take the depth, for printing.
+		if constexpr (std::is_invocable_v<Function&, uint16_t, std::span<const uint8_t>, unsigned>)
+			fn(code, data, depth);
+		else
+			fn(code, data);
+
+		// IAs carry addresses and prefixes which carry status codes, nothing
+		// legitimately nests deeper than that.
+		size_t offset = DHCPv6NestedOffset(code);
+		if (!offset || depth >= 2)
+			return;
+
+		if (data.size() < offset || !WalkNestedDHCPv6Options(data.subspan(offset), fn, depth + 1))
+			nested = false;
+	});
+
+	return valid && nested;
+}
+
+// Print the options of a DHCPv6 message, nested ones indented under the
+// option carrying them. Returns false if any option is malformed.
+bool PrintDHCPv6Options(FILE *out, std::span<const uint8_t> options);
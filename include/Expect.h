@@ -0,0 +1,121 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+
+#include "DHCP.h"
+
+/**
+ * Exit codes returned when validating a server's reply. These follow the
+ * monitoring plugin convention (OK, CRITICAL, UNKNOWN) so dhcputil can be
+ * dropped straight into Nagios, Icinga and friends. A server that doesn't
+ * answer is as critical as one that answers wrongly, while UNKNOWN is kept
+ * for usage and socket errors on our side.
+ */
+enum ExpectExitCode : int
+{
+	EXPECT_OK = 0,
+	EXPECT_FAILED = 2,
+	EXPECT_NOREPLY = 2,
+	EXPECT_ERROR = 3
+};
+
+enum class ExpectOperation : uint8_t
+{
+	PRESENT,
+	ABSENT,
+	EQUAL,
+	NOTEQUAL,
+	LESS,
+	LESSEQUAL,
+	GREATER,
+	GREATEREQUAL,
+	CONTAINS
+};
+
+/**
+ * A single compiled rule. Operands live in the program's shared pool
+ * so the instructions stay small and sit next to each other in memory.
+ */
+struct ExpectInstruction
+{
+	// The option code this instruction tests.
+	uint16_t code;
+	ExpectOperation op;
+	// Compare the option as a big-endian unsigned number instead of bytes.
+	bool numeric;
+	// Alignment used when searching with CONTAINS (eg. 4 for address lists).
+	uint16_t stride;
+	// Index of the rule this was compiled from, for reporting.
+	uint16_t rule;
+	// Numeric operand.
+	uint64_t number;
+	// Byte operand, as an offset and length into the pool.
+	uint32_t offset;
+	uint32_t length;
+	// Pass only if no copy of the option matches (!CODE OP VALUE).
+	bool negate;
+	// Numeric comparisons only read this many leading bytes, zero for all.
+	uint8_t width;
+};
+
+/**
+ * A set of --expect rules compiled into a decision table sorted by option
+ * code. A reply is checked in a single pass over its options: each option
+ * is looked up in the table and only the instructions for that code run.
+ *
+ * Rule syntax is [!]CODE[OP VALUE], where OP is one of = != < <= > >= or
+ * ~ (contains). VALUE may be a decimal number, a dotted IPv4 or IPv6
+ * address, hex (0x..., read as a number by the ordered operators) or a
+ * quoted string. A leading ! inverts the rule: the option must be absent,
+ * or no copy of it may match. DHCPv6 rules use the same syntax with 16
+ * bit option codes, and also see the options nested inside IAs.
+ */
+class ExpectProgram
+{
+	// The instructions, sorted by option code.
+	std::vector<ExpectInstruction> program_;
+
+	// Operand bytes referenced by the instructions.
+	std::vector<uint8_t> pool_;
+
+	// The source rules, used when printing results.
+	std::vector<std::string> rules_;
+
+	// Evaluation state, one entry per instruction. Kept around between
+	// evaluations so checking a reply does not allocate.
+	std::vector<uint8_t> seen_;
+	std::vector<uint8_t> matched_;
+	bool malformed_{false};
+
+	// Where options split over several parts are joined back together.
+	DHCPOptionScratch scratch_;
+
+	bool Test(const ExpectInstruction &ins, std::span<const uint8_t> data) const noexcept;
+
+public:
+	static std::optional<ExpectProgram> Compile(const std::vector<std::string> &rules, int family = AF_INET);
+
+	constexpr bool Empty() const noexcept { return this->program_.empty(); }
+
+	// Streaming interface, for anything that can walk options itself.
+	void Begin() noexcept;
+	void OnOption(uint16_t code, std::span<const uint8_t> data) noexcept;
+	size_t Finish() const noexcept;
+
+	// Evaluate the options area of a DHCPv4 reply, returning the number of
+	// rules which failed. Long options split per RFC 3396 are checked as one
+	// option. A malformed options area fails every rule.
+	size_t Evaluate(std::span<const uint8_t> options);
+
+	// The same for the options of a DHCPv6 reply, including the addresses,
+	// prefixes and status codes nested inside its IAs.
+	size_t EvaluateV6(std::span<const uint8_t> options) noexcept;
+
+	// Print the result of the last evaluation, one line per rule.
+	void Report(std::ostream &out, bool failures_only = false) const;
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+
+#include "Expect.h"
+#include "RingBuffer.h"
+#include "Socket.h"
+
+// How many probes worth of history we keep for each server.
+#define MONITOR_WINDOW 64
+
+struct MonitorServer
+{
+	// For DHCPv4 the server identifier (option 54), or siaddr if the server
+	// didn't send one. For DHCPv6 the server DUID in hex.
+	std::string name;
+
+	// Round trip time of each answered probe.
+	RingBuffer<std::chrono::microseconds, MONITOR_WINDOW> latency;
+
+	// Whether the server answered each probe.
+	RingBuffer<bool, MONITOR_WINDOW> answered;
+
+	// The last probe this server answered.
+	uint64_t last_probe{0};
+
+	// Hash of the options in the last reply, used to notice drift.
+	uint64_t fingerprint{0};
+
+	// Current state, alerts are only raised when these change.
+	bool up{true};
+	bool passing{true};
+};
+
+/**
+ * Long running probe loop. The socket, the request template and the
+ * expectation table are all set up once, so each probe costs one send,
+ * a few receives and a single pass over each reply's options. Whether
+ * DHCPv4 or DHCPv6 is spoken follows the family of the socket.
+ */
+class DHCPMonitor
+{
+	DHCPSessionSocket &sock_;
+
+	// The pre-built request, only the xid is changed between probes.
+	std::vector<uint8_t> template_;
+
+	// Receive buffer reused for every reply.
+	std::vector<uint8_t> buffer_;
+
+	// Where DHCPv4 options split over several parts are joined back together.
+	DHCPOptionScratch scratch_;
+
+	ExpectProgram &expectations_;
+
+	std::chrono::microseconds interval_;
+	std::chrono::microseconds jitter_;
+	std::chrono::microseconds timeout_;
+
+	std::mt19937 gen_;
+
+	std::vector<MonitorServer> servers_;
+
+	// Number of probes sent so far.
+	uint64_t probes_{0};
+
+	// Whether anyone answered the last probe.
+	bool answered_{true};
+
+	bool Probe();
+	void HandleReply(std::chrono::microseconds latency);
+	MonitorServer &FindServer(std::string &&name);
+	void PrintStatistics(const MonitorServer &server) const;
+
+public:
+	// A seed of zero picks a random one.
+	DHCPMonitor(DHCPSessionSocket &sock, std::vector<uint8_t> &&request, ExpectProgram &expectations,
+		std::chrono::microseconds interval, std::chrono::microseconds jitter, std::chrono::microseconds timeout,
+		uint64_t seed = 0);
+
+	// Not copyable
+	DHCPMonitor(const DHCPMonitor &) = delete;
+	DHCPMonitor &operator=(const DHCPMonitor &) = delete;
+
+	// Probe until interrupted by SIGINT or SIGTERM.
+	int Run();
+};
@@ -0,0 +1,52 @@
+#pragma once
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Text helpers shared by the --expect rules and the traffic profiles.
+
+inline std::string_view Trim(std::string_view str)
+{
+	while (!str.empty() && isspace(static_cast<unsigned char>(str.front())))
+		str.remove_prefix(1);
+	while (!str.empty() && isspace(static_cast<unsigned char>(str.back())))
+		str.remove_suffix(1);
+	return str;
+}
+
+// Parse the whole string as a number, anything left over is an error.
+template <typename T>
+std::optional<T> ParseNumber(std::string_view str, int base = 10)
+{
+	T value{};
+	std::from_chars_result res;
+	if constexpr (std::is_floating_point_v<T>)
+		res = std::from_chars(str.data(), str.data() + str.size(), value);
+	else
+		res = std::from_chars(str.data(), str.data() + str.size(), value, base);
+
+	if (res.ec != std::errc() || res.ptr != str.data() + str.size())
+		return std::nullopt;
+	return value;
+}
+
+// Append the bytes spelled out by pairs of hex digits to `out`. An empty
+// string is fine, an odd number of digits is not.
+inline bool ParseHex(std::string_view str, std::vector<uint8_t> &out)
+{
+	if (str.size() % 2)
+		return false;
+
+	for (size_t i = 0; i < str.size(); i += 2)
+	{
+		auto byte = ParseNumber<uint8_t>(str.substr(i, 2), 16);
+		if (!byte)
+			return false;
+		out.emplace_back(*byte);
+	}
+	return true;
+}
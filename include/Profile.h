@@ -0,0 +1,141 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/socket.h>
+
+#include "Expect.h"
+#include "Socket.h"
+
+enum class ProfileCurve : uint8_t
+{
+	// A steady `rate` messages per second.
+	CONSTANT,
+	// `rate`, jumping to `peak` for `burst` seconds at the start of every `period`.
+	BURST,
+	// A cosine between `rate` and `peak` repeating every `period` seconds.
+	DIURNAL
+};
+
+/**
+ * One message in a precomputed schedule. The schedule is built once up
+ * front so replaying it only has to wait for the offset, patch the
+ * template and send.
+ */
+struct ProfileEvent
+{
+	// Nanoseconds from the start of the replay.
+	uint64_t offset;
+	// Which client sends it, this picks the MAC address.
+	uint32_t client;
+	// Index into the profile's message mix.
+	uint32_t message;
+};
+
+/**
+ * A deterministic traffic profile. Profiles are plain text files of
+ * `key = value` lines where # starts a comment:
+ *
+ *   seed     = 42                    random seed, the same seed gives the same schedule
+ *   protocol = 4                     4 or 6
+ *   clients  = 1000                  client population size
+ *   mac      = 02:00:00:00:00:00     first client MAC, client N uses mac + N
+ *   duration = 60                    seconds of traffic
+ *   curve    = constant              constant, burst or diurnal
+ *   rate     = 100                   messages per second
+ *   peak     = 1000                  burst or diurnal peak rate
+ *   period   = 60                    seconds per burst or diurnal cycle
+ *   burst    = 5                     seconds each burst lasts
+ *   mix      = discover:90 inform:10   discover/inform for DHCPv4, solicit/inform for DHCPv6
+ *   option   = 60=6d736674           extra option added to every message (repeatable)
+ */
+class TrafficProfile
+{
+public:
+	uint64_t seed = 1;
+	int family = AF_INET;
+	uint32_t clients = 1;
+	std::array<uint8_t, 6> mac{0x02, 0x00, 0x00, 0x00, 0x00, 0x00};
+	double duration = 10;
+	ProfileCurve curve = ProfileCurve::CONSTANT;
+	double rate = 10;
+	double peak = 0;
+	double period = 60;
+	double burst = 1;
+
+	// Message types (DHCPMessageType or DHCPv6MessageType) and their weights.
+	std::vector<std::pair<uint8_t, uint32_t>> mix;
+
+	// Extra options added to every message.
+	std::vector<std::pair<uint16_t, std::vector<uint8_t>>> options;
+
+	static std::optional<TrafficProfile> Load(const std::string &path);
+
+	// Messages per second at `seconds` into the replay.
+	double RateAt(double seconds) const noexcept;
+
+	// The MAC address used by a client.
+	std::array<uint8_t, 6> ClientMAC(uint32_t client) const noexcept;
+
+	// The first transaction id, message N of the schedule uses this plus N.
+	uint32_t BaseTransactionID() const noexcept;
+
+	std::vector<ProfileEvent> BuildSchedule() const;
+};
+
+/**
+ * Replays a profile's schedule. A template is built for each message in
+ * the mix before the clock starts, so sending a message only patches its
+ * xid and MAC address. Sends are paced against absolute monotonic time so
+ * a late send never shifts the rest of the schedule.
+ */
+class ProfileReplay
+{
+	DHCPSessionSocket &sock_;
+
+	const TrafficProfile &profile_;
+
+	ExpectProgram &expectations_;
+
+	std::vector<ProfileEvent> schedule_;
+
+	// One pre-built message per entry in the mix.
+	std::vector<std::vector<uint8_t>> templates_;
+
+	// Where the MAC address sits in every template.
+	size_t mac_offset_{0};
+
+	// Receive buffer reused for every reply.
+	std::vector<uint8_t> buffer_;
+
+	// When each message was sent and how long its reply took, in
+	// nanoseconds. Zero means never sent or never answered.
+	std::vector<uint64_t> sent_;
+	std::vector<uint64_t> latency_;
+
+	size_t send_errors_{0};
+	uint64_t lateness_total_{0};
+	uint64_t lateness_max_{0};
+	size_t expectation_failures_{0};
+
+	void BuildTemplates();
+	void HandleReply(uint64_t now);
+	void Drain(int flags);
+
+public:
+	ProfileReplay(DHCPSessionSocket &sock, const TrafficProfile &profile, ExpectProgram &expectations);
+
+	// Not copyable
+	ProfileReplay(const ProfileReplay &) = delete;
+	ProfileReplay &operator=(const ProfileReplay &) = delete;
+
+	// Print the schedule as CSV so runs can be compared without a network.
+	void DumpSchedule(std::ostream &out) const;
+
+	int Run(std::chrono::seconds timeout);
+};
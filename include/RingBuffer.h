@@ -0,0 +1,45 @@
+#pragma once
+#include <array>
+#include <cstddef>
+
+/**
+ * A fixed size ring buffer which overwrites the oldest element once full.
+ * Everything lives inline so pushing never allocates, which is what we
+ * want for statistics gathered on every probe of a long running process.
+ */
+template <typename T, size_t N>
+class RingBuffer
+{
+	static_assert(N > 0, "RingBuffer needs room for at least one element");
+
+	std::array<T, N> data_{};
+
+	// Where the next element will be written.
+	size_t head_{0};
+
+	// How many elements are valid, up to N.
+	size_t size_{0};
+
+public:
+	constexpr void Push(const T &value) noexcept
+	{
+		this->data_[this->head_] = value;
+		this->head_ = (this->head_ + 1) % N;
+		if (this->size_ < N)
+			++this->size_;
+	}
+
+	constexpr void Clear() noexcept { this->head_ = this->size_ = 0; }
+
+	constexpr size_t Size() const noexcept { return this->size_; }
+	constexpr bool Empty() const noexcept { return this->size_ == 0; }
+	static constexpr size_t Capacity() noexcept { return N; }
+
+	// Index 0 is the oldest element still held, Size() - 1 the newest.
+	constexpr const T &operator[](size_t idx) const noexcept
+	{
+		return this->data_[(this->head_ + N - this->size_ + idx) % N];
+	}
+
+	constexpr const T &Back() const noexcept { return (*this)[this->size_ - 1]; }
+};
@@ -1,8 +1,15 @@
 #pragma once
 #include <array>
+#include <chrono>
 #include <ranges>
+#include <string>
+#include <string_view>
+#include <vector>
 #include <cstdint>
+#include <cstring>
 #include <format>
+#include <optional>
+#include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -10,6 +17,7 @@
 union sockaddrs
 {
 	struct sockaddr_in in;
+	struct sockaddr_in6 in6;
 	struct sockaddr sa;
 };
 
@@ -33,6 +41,22 @@ constexpr std::string IPv4ToString(in_addr_t address)
     );
 }
 
+inline std::string IPv6ToString(const struct in6_addr &address)
+{
+	char str[INET6_ADDRSTRLEN];
+	if (!inet_ntop(AF_INET6, &address, str, sizeof(str)))
+		return "";
+	return str;
+}
+
+inline std::optional<struct in6_addr> ToIPv6(std::string_view str)
+{
+	struct in6_addr address;
+	if (inet_pton(AF_INET6, std::string(str).c_str(), &address) != 1)
+		return std::nullopt;
+	return address;
+}
+
 template <std::ranges::range Range> 
 	requires std::convertible_to<std::ranges::range_value_t<std::remove_cvref_t<Range>>, uint8_t>
 constexpr std::optional<uint32_t> ToIPv4(Range &&range)
@@ -73,6 +97,12 @@ class DHCPSessionSocket
 	// The socket itself.
 	int sock_{-1};
 
+	// AF_INET for DHCPv4 or AF_INET6 for DHCPv6.
+	int family_{AF_INET};
+
+	// Index of the interface, used as the scope of link-local addresses.
+	unsigned int ifindex_{0};
+
 	// The interface we're bound to.
 	std::string interface_;
 
@@ -91,7 +121,8 @@ public:
 
 	// Can be moved
 	constexpr DHCPSessionSocket(DHCPSessionSocket &&rhs) noexcept : 
-		sock_(rhs.sock_), interface_(std::move(rhs.interface_)), interface_ip_(rhs.interface_ip_),
+		sock_(rhs.sock_), family_(rhs.family_), ifindex_(rhs.ifindex_),
+		interface_(std::move(rhs.interface_)), interface_ip_(rhs.interface_ip_),
 		hardware_id_(std::move(rhs.hardware_id_))
 	{ 
 		rhs.sock_ = -1; 
@@ -105,6 +136,8 @@ public:
 
 		// Move/copy data
 		this->sock_ = rhs.sock_;
+		this->family_ = rhs.family_;
+		this->ifindex_ = rhs.ifindex_;
 		this->interface_ = std::move(rhs.interface_);
 		this->interface_ip_ = rhs.interface_ip_;
 		this->hardware_id_ = std::move(rhs.hardware_id_);
@@ -120,8 +153,13 @@ public:
 	constexpr in_addr_t GetInterfaceAddress() const noexcept { return this->interface_ip_; }
 	constexpr std::array<uint8_t, 6> GetInterfaceHWID() const noexcept { return this->hardware_id_; }
 	constexpr std::string_view GetInterface() const noexcept { return this->interface_; }
+	constexpr int GetFamily() const noexcept { return this->family_; }
 
 	bool SetSocketOption(int option, bool state);
+	bool SetReceiveTimeout(std::chrono::microseconds timeout);
+
+	// Wait up to timeout for a datagram to arrive, returns true if one did.
+	bool WaitReadable(std::chrono::nanoseconds timeout);
 
 	template <std::ranges::range Range> 
 		requires std::convertible_to<std::ranges::range_value_t<std::remove_cvref_t<Range>>, uint8_t>
@@ -138,8 +176,9 @@ public:
 	}
 
 	// Open a sock_et.
-	int OpenInterface(std::string iface);
+	int OpenInterface(std::string iface, int family = AF_INET);
 	bool BindSocket(in_addr_t ipaddr, in_port_t port);
+	bool BindSocket(const struct in6_addr &ipaddr, in_port_t port);
 	bool BindSocket(std::string_view bindaddr, in_port_t port);
 
 	template <std::ranges::range Range> 
@@ -171,5 +210,24 @@ public:
 		return this->Send(*address, port, std::move(data));
 	}
 
-	ssize_t Recieve(in_addr_t ipaddr, in_port_t port, std::vector<uint8_t> &buf);
+	template <std::ranges::range Range> 
+		requires std::convertible_to<std::ranges::range_value_t<std::remove_cvref_t<Range>>, uint8_t>
+	ssize_t Send(const struct in6_addr &ipaddr, in_port_t port, Range &&data)
+	{
+		sockaddrs sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.in6.sin6_family = AF_INET6;
+		sa.in6.sin6_port = htons(port);
+		sa.in6.sin6_addr = ipaddr;
+		// Link-local destinations (like ff02::1:2) need to know which link.
+		sa.in6.sin6_scope_id = this->ifindex_;
+
+		const uint8_t *pdata = reinterpret_cast<const uint8_t*>(std::ranges::cdata(data));
+		size_t length = std::ranges::size(data);
+
+		return ::sendto(this->sock_, pdata, length, 0, &sa.sa, sizeof(struct sockaddr_in6));
+	}
+
+	// Pass MSG_DONTWAIT in flags to poll without blocking.
+	ssize_t Recieve(in_addr_t ipaddr, in_port_t port, std::vector<uint8_t> &buf, int flags = 0);
 };
@@ -0,0 +1,46 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "DHCP.h"
+#include "Socket.h"
+
+bool PrintDHCPPacket(FILE *out, std::span<const uint8_t> datagram)
+{
+	if (datagram.size() < sizeof(struct DHCPPacket))
+		return false;
+
+	const struct DHCPPacket *packet = reinterpret_cast<const struct DHCPPacket*>(datagram.data());
+
+	fprintf(out, "op: 0x%X\n", packet->op);
+	fprintf(out, "htype: 0x%X\n", packet->htype);
+	fprintf(out, "hlen: %d\n", packet->hlen);
+	fprintf(out, "hops: %d\n", packet->hops);
+	fprintf(out, "xid: 0x%X\n", packet->xid);
+	fprintf(out, "secs: %d\n", packet->secs);
+	fprintf(out, "flags: 0x%X\n", packet->flags);
+	fprintf(out, "ciaddr: %s\n", IPv4ToString(packet->ciaddr).c_str());
+	fprintf(out, "yiaddr: %s\n", IPv4ToString(packet->yiaddr).c_str());
+	fprintf(out, "siaddr: %s\n", IPv4ToString(packet->siaddr).c_str());
+	fprintf(out, "giaddr: %s\n", IPv4ToString(packet->giaddr).c_str());
+
+	// hlen, sname and file come straight off the wire, so never trust them
+	// to fit their fields or to be NUL terminated.
+	size_t hlen = std::min<size_t>(packet->hlen, sizeof(packet->chaddr));
+	fprintf(out, "chaddr: ");
+	for (size_t i = 0; i < hlen; ++i)
+		fprintf(out, "%0X%s", static_cast<uint8_t>(packet->chaddr[i]), (i + 1 == hlen ? "" : ":"));
+	fprintf(out, "\nsname: %.*s\n", static_cast<int>(sizeof(packet->sname)), packet->sname);
+	fprintf(out, "file: %.*s\n", static_cast<int>(sizeof(packet->file)), packet->file);
+	fprintf(out, "cookie: 0x%X\n\nDHCP Options\n", packet->cookie);
+
+	// The DHCP options come after the header printed above. Every length is
+	// checked against the buffer since servers (or anyone else on the
+	// network) can send us whatever they like.
+	DHCPOptionScratch scratch;
+	return WalkLongDHCPOptions(GetDHCPOptions(datagram), scratch, [out](uint8_t code, std::span<const uint8_t> data) {
+		fprintf(out, "Option %d: ", code);
+		for (uint8_t byte : data)
+			fprintf(out, "%X", byte);
+		fprintf(out, "\n");
+	});
+}
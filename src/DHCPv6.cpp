@@ -0,0 +1,50 @@
+#include <cstdio>
+#include <cstring>
+
+#include "DHCPv6.h"
+#include "Socket.h"
+
+bool PrintDHCPv6Options(FILE *out, std::span<const uint8_t> options)
+{
+	return WalkNestedDHCPv6Options(options, [out](uint16_t code, std::span<const uint8_t> data, unsigned depth) {
+		int indent = static_cast<int>(depth) * 2;
+		fprintf(out, "%*sOption %d: ", indent, "", code);
+		for (uint8_t byte : data)
+			fprintf(out, "%02X", byte);
+		fprintf(out, "\n");
+
+		// Decode the fields we know, their nested options follow on their own.
+		struct in6_addr address;
+		switch (code)
+		{
+			case OPTION_IAADDR:
+				// address, preferred lifetime, valid lifetime, options
+				if (data.size() < sizeof(address) + 8)
+					break;
+				memcpy(&address, data.data(), sizeof(address));
+				fprintf(out, "%*saddress: %s\n", indent + 2, "", IPv6ToString(address).c_str());
+				break;
+			case OPTION_IAPREFIX:
+				// preferred lifetime, valid lifetime, prefix length, prefix, options
+				if (data.size() < 9 + sizeof(address))
+					break;
+				memcpy(&address, data.data() + 9, sizeof(address));
+				fprintf(out, "%*sprefix: %s/%d\n", indent + 2, "", IPv6ToString(address).c_str(), data[8]);
+				break;
+			case OPTION_DNS_SERVERS:
+				for (size_t i = 0; i + sizeof(address) <= data.size(); i += sizeof(address))
+				{
+					memcpy(&address, data.data() + i, sizeof(address));
+					fprintf(out, "%*sdns: %s\n", indent + 2, "", IPv6ToString(address).c_str());
+				}
+				break;
+			case OPTION_STATUS_CODE:
+				if (data.size() >= 2)
+					fprintf(out, "%*sstatus %d: %.*s\n", indent + 2, "", data[0] << 8 | data[1],
+						static_cast<int>(data.size() - 2), reinterpret_cast<const char*>(data.data() + 2));
+				break;
+			default:
+				break;
+		}
+	});
+}
@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+#include <arpa/inet.h>
+
+#include "DHCP.h"
+#include "DHCPv6.h"
+#include "Expect.h"
+#include "Parse.h"
+
+// Operators ordered so that the two character ones are tried first.
+static constexpr std::pair<std::string_view, ExpectOperation> operators[] = {
+	{"!=", ExpectOperation::NOTEQUAL},
+	{"<=", ExpectOperation::LESSEQUAL},
+	{">=", ExpectOperation::GREATEREQUAL},
+	{"==", ExpectOperation::EQUAL},
+	{"=", ExpectOperation::EQUAL},
+	{"<", ExpectOperation::LESS},
+	{">", ExpectOperation::GREATER},
+	{"~", ExpectOperation::CONTAINS},
+};
+
+// Interpret option data as a big-endian unsigned integer, like lease times.
+static std::optional<uint64_t> ToNumber(std::span<const uint8_t> data) noexcept
+{
+	if (data.empty() || data.size() > sizeof(uint64_t))
+		return std::nullopt;
+
+	uint64_t value = 0;
+	for (uint8_t byte : data)
+		value = value << 8 | byte;
+	return value;
+}
+
+std::optional<ExpectProgram> ExpectProgram::Compile(const std::vector<std::string> &rules, int family)
+{
+	ExpectProgram prog;
+
+	for (const std::string &rule : rules)
+	{
+		std::string_view text = Trim(rule);
+		ExpectInstruction ins{};
+		ins.op = ExpectOperation::PRESENT;
+		ins.rule = static_cast<uint16_t>(prog.rules_.size());
+		ins.stride = 1;
+
+		if (text.starts_with('!'))
+		{
+			ins.op = ExpectOperation::ABSENT;
+			ins.negate = true;
+			text.remove_prefix(1);
+		}
+
+		// Split the rule into the option code and the (optional) operand.
+		std::string_view code = text, operand;
+		size_t split = text.find_first_of("!=<>~");
+		if (split != std::string_view::npos)
+		{
+			ins.op = ExpectOperation::PRESENT;
+			code = text.substr(0, split);
+			for (const auto &[symbol, op] : operators)
+			{
+				if (text.substr(split).starts_with(symbol))
+				{
+					ins.op = op;
+					operand = Trim(text.substr(split + symbol.size()));
+					break;
+				}
+			}
+
+			if (ins.op == ExpectOperation::PRESENT || operand.empty())
+			{
+				std::cerr << "Invalid expectation \"" << rule << "\": missing operator or value" << std::endl;
+				return std::nullopt;
+			}
+		}
+
+		// DHCPv6 option codes are 16 bits wide.
+		auto optcode = ParseNumber<uint16_t>(Trim(code));
+		uint16_t maxcode = family == AF_INET6 ? 0xFFFF : 0xFF;
+		if (!optcode || *optcode > maxcode)
+		{
+			std::cerr << "Invalid expectation \"" << rule << "\": option code must be 0-" << maxcode << std::endl;
+			return std::nullopt;
+		}
+		ins.code = *optcode;
+
+		// A status code is a 16 bit number followed by a message, compare
+		// only the number so rules like !13>0 catch any error status.
+		if (family == AF_INET6 && ins.code == OPTION_STATUS_CODE)
+			ins.width = 2;
+
+		// Decode the operand into the pool.
+		std::vector<uint8_t> bytes;
+		if (operand.empty())
+		{
+			// Presence checks carry no operand.
+		}
+		else if (operand.size() >= 2 && (operand.front() == '"' || operand.front() == '\'') && operand.back() == operand.front())
+			bytes.assign(operand.begin() + 1, operand.end() - 1);
+		else if (operand.starts_with("0x") || operand.starts_with("0X"))
+		{
+			if (operand.size() == 2 || !ParseHex(operand.substr(2), bytes))
+			{
+				std::cerr << "Invalid expectation \"" << rule << "\": bad hex value" << std::endl;
+				return std::nullopt;
+			}
+
+			// Ordered comparisons read the hex as a number, the rest compare bytes.
+			switch (ins.op)
+			{
+				case ExpectOperation::LESS:
+				case ExpectOperation::LESSEQUAL:
+				case ExpectOperation::GREATER:
+				case ExpectOperation::GREATEREQUAL:
+					if (auto number = ToNumber(bytes); number)
+					{
+						ins.numeric = true;
+						ins.number = *number;
+						bytes.clear();
+					}
+					break;
+				default:
+					break;
+			}
+		}
+		else if (operand.find(':') != std::string_view::npos)
+		{
+			in6_addr addr;
+			if (inet_pton(AF_INET6, std::string(operand).c_str(), &addr) != 1)
+			{
+				std::cerr << "Invalid expectation \"" << rule << "\": bad IPv6 address" << std::endl;
+				return std::nullopt;
+			}
+			bytes.resize(sizeof(addr));
+			memcpy(bytes.data(), &addr, sizeof(addr));
+			ins.stride = sizeof(addr);
+		}
+		else if (operand.find('.') != std::string_view::npos)
+		{
+			in_addr addr;
+			if (inet_pton(AF_INET, std::string(operand).c_str(), &addr) != 1)
+			{
+				std::cerr << "Invalid expectation \"" << rule << "\": bad IPv4 address" << std::endl;
+				return std::nullopt;
+			}
+			bytes.resize(sizeof(addr));
+			memcpy(bytes.data(), &addr, sizeof(addr));
+			// Address lists (routers, DNS servers) are searched per address.
+			ins.stride = sizeof(addr);
+		}
+		else if (auto number = ParseNumber<uint64_t>(operand); number)
+		{
+			ins.numeric = true;
+			ins.number = *number;
+
+			if (ins.op == ExpectOperation::CONTAINS)
+			{
+				// Searching for a number only makes sense for byte lists,
+				// like the parameter request list.
+				if (*number > 0xFF)
+				{
+					std::cerr << "Invalid expectation \"" << rule << "\": contains only accepts numbers 0-255" << std::endl;
+					return std::nullopt;
+				}
+				ins.numeric = false;
+				bytes.emplace_back(static_cast<uint8_t>(*number));
+			}
+		}
+		else
+		{
+			std::cerr << "Invalid expectation \"" << rule << "\": unrecognised value \"" << operand << "\"" << std::endl;
+			return std::nullopt;
+		}
+
+		switch (ins.op)
+		{
+			case ExpectOperation::LESS:
+			case ExpectOperation::LESSEQUAL:
+			case ExpectOperation::GREATER:
+			case ExpectOperation::GREATEREQUAL:
+				if (!ins.numeric)
+				{
+					std::cerr << "Invalid expectation \"" << rule << "\": ordered comparisons need a number or at most 8 hex bytes" << std::endl;
+					return std::nullopt;
+				}
+				break;
+			default:
+				break;
+		}
+
+		ins.offset = static_cast<uint32_t>(prog.pool_.size());
+		ins.length = static_cast<uint32_t>(bytes.size());
+		prog.pool_.insert(prog.pool_.end(), bytes.begin(), bytes.end());
+		prog.program_.emplace_back(ins);
+		prog.rules_.emplace_back(rule);
+	}
+
+	// Sort by option code so each option only has to look at its own rules.
+	std::ranges::stable_sort(prog.program_, {}, &ExpectInstruction::code);
+
+	prog.seen_.resize(prog.program_.size());
+	prog.matched_.resize(prog.program_.size());
+
+	return prog;
+}
+
+bool ExpectProgram::Test(const ExpectInstruction &ins, std::span<const uint8_t> data) const noexcept
+{
+	std::span<const uint8_t> value{this->pool_.data() + ins.offset, ins.length};
+
+	if (ins.numeric)
+	{
+		if (ins.width && data.size() < ins.width)
+			return false;
+
+		auto number = ToNumber(ins.width ? data.first(ins.width) : data);
+		if (!number)
+			return false;
+
+		switch (ins.op)
+		{
+			case ExpectOperation::EQUAL:        return *number == ins.number;
+			case ExpectOperation::NOTEQUAL:     return *number != ins.number;
+			case ExpectOperation::LESS:         return *number < ins.number;
+			case ExpectOperation::LESSEQUAL:    return *number <= ins.number;
+			case ExpectOperation::GREATER:      return *number > ins.number;
+			case ExpectOperation::GREATEREQUAL: return *number >= ins.number;
+			default:                            return false;
+		}
+	}
+
+	switch (ins.op)
+	{
+		case ExpectOperation::EQUAL:
+			return std::ranges::equal(data, value);
+		case ExpectOperation::NOTEQUAL:
+			return !std::ranges::equal(data, value);
+		case ExpectOperation::CONTAINS:
+			for (size_t i = 0; i + value.size() <= data.size(); i += ins.stride)
+				if (std::ranges::equal(data.subspan(i, value.size()), value))
+					return true;
+			return false;
+		default:
+			return false;
+	}
+}
+
+void ExpectProgram::Begin() noexcept
+{
+	this->malformed_ = false;
+	std::ranges::fill(this->seen_, 0);
+	std::ranges::fill(this->matched_, 0);
+}
+
+void ExpectProgram::OnOption(uint16_t code, std::span<const uint8_t> data) noexcept
+{
+	auto it = std::ranges::lower_bound(this->program_, code, {}, &ExpectInstruction::code);
+
+	for (; it != this->program_.end() && it->code == code; ++it)
+	{
+		size_t idx = static_cast<size_t>(it - this->program_.begin());
+		this->seen_[idx] = 1;
+
+		// DHCPv4 options are joined before they get here, but DHCPv6 ones can
+		// repeat (a status code in every IA) and pass if any copy matches.
+		if (!this->matched_[idx] && it->op != ExpectOperation::PRESENT && it->op != ExpectOperation::ABSENT)
+			this->matched_[idx] = this->Test(*it, data);
+	}
+}
+
+size_t ExpectProgram::Finish() const noexcept
+{
+	if (this->malformed_)
+		return this->program_.size();
+
+	size_t failed = 0;
+	for (size_t i = 0; i < this->program_.size(); ++i)
+	{
+		switch (this->program_[i].op)
+		{
+			case ExpectOperation::PRESENT: failed += !this->seen_[i]; break;
+			case ExpectOperation::ABSENT:  failed += this->seen_[i]; break;
+			default:                       failed += this->program_[i].negate ? this->matched_[i] : !this->matched_[i]; break;
+		}
+	}
+	return failed;
+}
+
+size_t ExpectProgram::Evaluate(std::span<const uint8_t> options)
+{
+	this->Begin();
+
+	bool valid = WalkLongDHCPOptions(options, this->scratch_, [this](uint8_t code, std::span<const uint8_t> data) {
+		this->OnOption(code, data);
+	});
+
+	if (!valid)
+	{
+		// Don't trust anything we gathered from a broken packet.
+		this->malformed_ = true;
+		return this->program_.size();
+	}
+
+	return this->Finish();
+}
+
+size_t ExpectProgram::EvaluateV6(std::span<const uint8_t> options) noexcept
+{
+	this->Begin();
+
+	bool valid = WalkNestedDHCPv6Options(options, [this](uint16_t code, std::span<const uint8_t> data) {
+		this->OnOption(code, data);
+	});
+
+	if (!valid)
+	{
+		this->malformed_ = true;
+		return this->program_.size();
+	}
+
+	return this->Finish();
+}
+
+void ExpectProgram::Report(std::ostream &out, bool failures_only) const
+{
+	std::vector<bool> passed(this->rules_.size());
+
+	if (this->malformed_)
+		out << "Reply options are malformed\n";
+
+	for (size_t i = 0; i < this->program_.size() && !this->malformed_; ++i)
+	{
+		const ExpectInstruction &ins = this->program_[i];
+		switch (ins.op)
+		{
+			case ExpectOperation::PRESENT: passed[ins.rule] = this->seen_[i]; break;
+			case ExpectOperation::ABSENT:  passed[ins.rule] = !this->seen_[i]; break;
+			default:                       passed[ins.rule] = ins.negate ? !this->matched_[i] : this->matched_[i]; break;
+		}
+	}
+
+	for (size_t i = 0; i < this->rules_.size(); ++i)
+		if (!failures_only || !passed[i])
+			out << (passed[i] ? "PASS: " : "FAIL: ") << this->rules_[i] << "\n";
+}
@@ -1,11 +1,12 @@
 #include "vendor/CLI11.hpp"
 #include <cstring>
+#include <chrono>
 #include <random>
 #include <string>
 #include <format>
 #include <cstdint>
 #include <cstdlib>
-#include <cassert>
+#include <optional>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -13,6 +14,10 @@
 #include <net/if.h>
 
 #include "DHCP.h"
+#include "DHCPv6.h"
+#include "Expect.h"
+#include "Monitor.h"
+#include "Profile.h"
 #include "Socket.h"
 
 // Reference information
@@ -20,6 +25,7 @@
 // https://datatracker.ietf.org/doc/html/rfc2131
 // https://datatracker.ietf.org/doc/html/rfc2132
 // https://www.man7.org/linux/man-pages/man7/netdevice.7.html
+// https://datatracker.ietf.org/doc/html/rfc8415
 
 class CommandLine
 {
@@ -28,7 +34,9 @@ public:
 	std::string ip = "";
 	int seconds = 0;
 	uint32_t xid = 0;
+	std::string operation = "request";
 	DHCPMessageType mtype{DHCPREQUEST};
+	DHCPv6MessageType mtype6{DHCPV6_REQUEST};
 	uint16_t flags = 0x8000; // broadcast bit set
 	std::string yip = "0.0.0.0";
 	std::string gip = "0.0.0.0";
@@ -37,6 +45,11 @@ public:
 	int verbosity = 1;
 	int timeout = 5;
 
+	// Monitoring options
+	bool monitor = false;
+	double interval = 60;
+	double jitter = 0;
+
 	// Options with choices
 	std::map<std::string, DHCPMessageType> choices{
 		{"discover", DHCPDISCOVER}, 
@@ -45,6 +58,12 @@ public:
 		{"inform", DHCPINFORM}
 	};
 	// std::vector<std::string> operation = {"discover", "request", "release", "decline", "inform"};
+	std::map<std::string, DHCPv6MessageType> choices6{
+		{"solicit", DHCPV6_SOLICIT},
+		{"discover", DHCPV6_SOLICIT},
+		{"request", DHCPV6_REQUEST},
+		{"inform", DHCPV6_INFORMATION_REQUEST}
+	};
 
 	// Options with values
 	std::vector<std::pair<std::string, std::string>> sip = {{"--sip", ""}};
@@ -54,6 +73,9 @@ public:
 	std::vector<std::pair<std::string, std::string>> dhcp_opts = {{"-X", ""}};
 	std::string dhcp_opts_values;
 
+	// Rules the reply must satisfy (e.g. --expect '51>=3600')
+	std::vector<std::string> expects;
+
 	// Options with existing values
 	int reply_cnt = 0; // default is unlimited
 					  
@@ -63,12 +85,22 @@ public:
 	int ttl = 0;
 	uint8_t tos = 0;
 
+	// Reproducible runs
+	uint64_t seed = 0;
+	std::string profile = "";
+	bool dump_schedule = false;
+
+	// IPv6 options
+	bool ipv6 = false;
+	bool ia_pd = false;
+
 	// Ethernet options
 	std::string dst_ether = "";
 
 	std::string interface{""};
 
-	int Parse(int argc, char **argv)
+	// Returns the exit code if the program should stop here, or nothing to carry on.
+	std::optional<int> Parse(int argc, char **argv)
 	{
 		CLI::App app("dhcputil");
 
@@ -79,7 +111,7 @@ public:
 		xid = distrib(gen);
 
 		// Required options
-		app.add_option("-i", interface, "Network interface to use.")->required();
+		app.add_option("-i", interface, "Network interface to use (not needed with --dump-schedule).");
 		app.add_option("-c,--client-ip", ip, "Client IP address.")->default_val(ip);
 		app.add_option("-s,--seconds", seconds, "Seconds since client began acquisition process.")->default_val(seconds);
 		app.add_option("--xid", xid, "Set transaction ID to xid.")->default_val(xid);
@@ -90,19 +122,72 @@ public:
 		app.add_option("--client-boot-file", fname, "Client boot file name string.")->default_val(fname);
 		// app.add_option("-v,--verbosity", verbosity, "How chatty we should be (default: 1).")->default_val(verbosity);
 		app.add_option("-t,--timeout", timeout, "Seconds to wait for any replies before exiting (default: 5).")->default_val(timeout);
-		app.add_option("--operation", mtype, "DHCP message type (default: \"request\").")->transform(CLI::CheckedTransformer(choices, CLI::ignore_case));
+		std::vector<std::string> operations;
+		for (const auto &[name, type] : choices)
+			operations.emplace_back(name);
+		for (const auto &[name, type] : choices6)
+			if (!choices.contains(name))
+				operations.emplace_back(name);
+
+		app.add_option("--operation", operation, "DHCP message type (default: \"request\").")->check(CLI::IsMember(operations, CLI::ignore_case));
 		app.add_option("-S,--server-ip", sip_value, "Server IP address (gotten from OFFER, default: 0.0.0.0).")->default_val(sip_value);
 		app.add_option("-X,--dhcp-opt", dhcp_opts_values, "DHCP option (e.g. -X 50=c0a80189).");
+		app.add_option("-e,--expect", expects, "Check the reply against a rule (e.g. 121, !252, 51>=3600, 6~10.0.0.53).");
+		CLI::Option *monitor_opt = app.add_flag("--monitor", monitor, "Keep running and probe the server every interval.");
+		app.add_option("--interval", interval, "Seconds between probes in monitor mode (default: 60).")->default_val(interval)->check(CLI::PositiveNumber);
+		app.add_option("--jitter", jitter, "Add up to this many random seconds to each interval (default: 0).")->default_val(jitter)->check(CLI::NonNegativeNumber);
 		app.add_option("--reply-cnt", reply_cnt, "Maximum number of replies to wait for before exiting.")->default_val(reply_cnt);
 		app.add_option("-F,--src-ip", src_ip, "Send IP datagram from this source IP address.")->default_val(src_ip);
 		app.add_option("-T,--dst-ip", dst_ip, "Send IP datagram to this destination IP address.")->default_val(dst_ip);
 		app.add_option("--ttl", ttl, "Use this TTL value for outgoing datagrams.")->default_val(ttl);
 		// app.add_option("--tos", tos, "Use this type-of-service value for outgoing datagrams.")->default_val(tos);
+		CLI::Option *ipv6_opt = app.add_flag("-6,--ipv6", ipv6, "Use DHCPv6 instead of DHCPv4.");
+		app.add_flag("--ia-pd", ia_pd, "Also ask for a delegated prefix (DHCPv6 only).");
+		app.add_option("--seed", seed, "Seed for transaction ids and schedules, 0 for random (default: 0).")->default_val(seed);
+		// Profiles pick their own protocol and run once, so they can't be mixed with -6 or --monitor.
+		CLI::Option *profile_opt = app.add_option("--profile", profile, "Replay the traffic profile in this file.")->excludes(monitor_opt)->excludes(ipv6_opt);
+		app.add_flag("--dump-schedule", dump_schedule, "Print the profile's schedule as CSV instead of sending it.")->needs(profile_opt);
 		app.add_option("-E,--dst-ether", dst_ether, "Use this destination MAC address (default: ff:ff:ff:ff:ff:ff).")->default_val(dst_ether);
 
-		CLI11_PARSE(app, argc, argv);
-
-		return 0;
+		try
+		{
+			app.parse(argc, argv);
+		}
+		catch (const CLI::ParseError &e)
+		{
+			// --help and friends exit cleanly, usage errors are UNKNOWN as far
+			// as a monitoring system is concerned.
+			return app.exit(e) ? EXPECT_ERROR : EXPECT_OK;
+		}
+
+		// Only dumping a schedule gets away without touching the network.
+		if (interface.empty() && !dump_schedule)
+		{
+			std::cerr << "-i is required" << std::endl;
+			return EXPECT_ERROR;
+		}
+
+		// With a seed the xid is the same on every run, unless given explicitly.
+		if (seed && app.count("--xid") == 0)
+			xid = std::max<uint32_t>(static_cast<uint32_t>(std::mt19937_64(seed)() >> 32), 1);
+
+		// Both protocols share the operation names, resolve them now we know which one.
+		if (ipv6)
+		{
+			if (auto it = choices6.find(operation); it != choices6.end())
+			{
+				mtype6 = it->second;
+				return std::nullopt;
+			}
+		}
+		else if (auto it = choices.find(operation); it != choices.end())
+		{
+			mtype = it->second;
+			return std::nullopt;
+		}
+
+		std::cerr << "Operation \"" << operation << "\" is not supported by DHCPv" << (ipv6 ? 6 : 4) << std::endl;
+		return EXPECT_ERROR;
 	}
 };
 
@@ -144,24 +229,222 @@ void print_xxd(const std::vector<uint8_t>& vec) {
 }
 
 
+// Build a DHCPv6 message. A Request echoes the server id and the
+// IAs from the Advertise it is answering.
+static std::vector<uint8_t> BuildDHCPv6Message(const CommandLine &cmdline, const DHCPSessionSocket &sock,
+	DHCPv6MessageType type, uint32_t xid, std::span<const uint8_t> advertise = {})
+{
+	DHCPv6Payload payload(type, xid);
+	std::array<uint8_t, 6> hwid = sock.GetInterfaceHWID();
+
+	payload.AddOption(OPTION_CLIENTID, DHCPv6DUIDLL(hwid));
+
+	// Elapsed time is in hundredths of a second.
+	uint16_t elapsed = static_cast<uint16_t>(std::clamp(cmdline.seconds * 100, 0, 0xFFFF));
+	payload.AddOption(OPTION_ELAPSED_TIME, std::array<uint8_t, 2>{static_cast<uint8_t>(elapsed >> 8), static_cast<uint8_t>(elapsed)});
+
+	payload.AddOption(OPTION_ORO, std::array<uint8_t, 4>{0, OPTION_DNS_SERVERS, 0, OPTION_DOMAIN_LIST});
+
+	if (type == DHCPV6_REQUEST)
+	{
+		WalkDHCPv6Options(advertise, [&payload](uint16_t code, std::span<const uint8_t> data) {
+			if (code == OPTION_SERVERID || code == OPTION_IA_NA || code == OPTION_IA_PD)
+				payload.AddOption(code, data);
+		});
+	}
+	else if (type == DHCPV6_SOLICIT)
+	{
+		// Use the tail of the MAC as the IAID so it stays the same between runs.
+		uint32_t iaid = static_cast<uint32_t>(hwid[2]) << 24 | static_cast<uint32_t>(hwid[3]) << 16 | static_cast<uint32_t>(hwid[4]) << 8 | hwid[5];
+		payload.AddOption(OPTION_IA_NA, DHCPv6IA(iaid));
+		if (cmdline.ia_pd)
+			payload.AddOption(OPTION_IA_PD, DHCPv6IA(iaid));
+	}
+
+	return std::move(payload.GetStructureData());
+}
+
+// Send a DHCPv6 message and wait for the reply of the given type, returning
+// zero or the exit code main() should return.
+static int ExchangeDHCPv6(DHCPSessionSocket &sock, const std::vector<uint8_t> &message, DHCPv6MessageType expect,
+	int timeout, std::vector<uint8_t> &buffer)
+{
+	ssize_t written = sock.Send(DHCPV6_ALL_SERVERS, DHCPV6_SERVER_PORT, message);
+	if (written < 0)
+	{
+		std::cerr << "Failed to send datagram: " << strerror(errno) << std::endl;
+		return EXPECT_ERROR;
+	}
+
+	std::cerr << "Wrote " << written << " bytes!" << std::endl;
+
+	uint32_t xid = GetDHCPv6TransactionID(reinterpret_cast<const struct DHCPv6Packet*>(message.data()));
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout);
+
+	for (;;)
+	{
+		auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+		if (!sock.SetReceiveTimeout(remaining))
+			return EXPECT_ERROR;
+
+		if (sock.Recieve(INADDR_ANY, DHCPV6_CLIENT_PORT, buffer) < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				std::cerr << "No reply received within " << timeout << " seconds" << std::endl;
+				return EXPECT_NOREPLY;
+			}
+
+			perror("recvfrom");
+			return EXPECT_ERROR;
+		}
+
+		if (buffer.size() < sizeof(struct DHCPv6Packet))
+			continue;
+
+		const struct DHCPv6Packet *reply = reinterpret_cast<const struct DHCPv6Packet*>(buffer.data());
+		if (reply->msg_type == expect && GetDHCPv6TransactionID(reply) == xid)
+			break;
+	}
+
+	const struct DHCPv6Packet *reply = reinterpret_cast<const struct DHCPv6Packet*>(buffer.data());
+
+	printf("Received %zu bytes of data!\n", buffer.size());
+	print_xxd(buffer);
+	printf("msg-type: %d\n", reply->msg_type);
+	printf("xid: 0x%X\n\nDHCPv6 Options\n", GetDHCPv6TransactionID(reply));
+	if (!PrintDHCPv6Options(stdout, GetDHCPv6Options(buffer)))
+		std::cerr << "Reply contains a malformed option, ignoring the rest" << std::endl;
+
+	return 0;
+}
+
+static int RunDHCPv6(const CommandLine &cmdline, ExpectProgram &expectations)
+{
+	DHCPSessionSocket sock;
+	if (int res = sock.OpenInterface(cmdline.interface, AF_INET6); res)
+	{
+		std::cerr << "Failed to open a new socket: " << strerror(errno) << std::endl;
+		return EXPECT_ERROR;
+	}
+
+	// Bind to port 546 (as client)
+	if (!sock.BindSocket(in6addr_any, DHCPV6_CLIENT_PORT))
+		return EXPECT_ERROR;
+
+	// DHCPv6 transaction ids are only 24 bits wide.
+	uint32_t xid = cmdline.xid & 0xFFFFFF;
+
+	// Requests and solicits both start by finding a server.
+	DHCPv6MessageType first = cmdline.mtype6 == DHCPV6_INFORMATION_REQUEST ? DHCPV6_INFORMATION_REQUEST : DHCPV6_SOLICIT;
+	std::vector<uint8_t> message = BuildDHCPv6Message(cmdline, sock, first, xid);
+
+	if (cmdline.monitor)
+	{
+		auto seconds = [](double secs) {
+			return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::duration<double>(secs));
+		};
+
+		DHCPMonitor monitor(sock, std::move(message), expectations,
+			seconds(cmdline.interval), seconds(cmdline.jitter), std::chrono::seconds(cmdline.timeout), cmdline.seed);
+		return monitor.Run();
+	}
+
+	std::vector<uint8_t> buffer;
+	buffer.reserve(1024);
+
+	DHCPv6MessageType reply = first == DHCPV6_SOLICIT ? DHCPV6_ADVERTISE : DHCPV6_REPLY;
+	if (int res = ExchangeDHCPv6(sock, message, reply, cmdline.timeout, buffer); res)
+		return res;
+
+	if (cmdline.mtype6 == DHCPV6_REQUEST)
+	{
+		// Request what we were just advertised, as a new transaction.
+		message = BuildDHCPv6Message(cmdline, sock, DHCPV6_REQUEST, (xid + 1) & 0xFFFFFF, GetDHCPv6Options(buffer));
+		printf("\n");
+		if (int res = ExchangeDHCPv6(sock, message, DHCPV6_REPLY, cmdline.timeout, buffer); res)
+			return res;
+	}
+
+	if (expectations.Empty())
+		return EXIT_SUCCESS;
+
+	printf("\nExpectations\n");
+	size_t failed = expectations.EvaluateV6(GetDHCPv6Options(buffer));
+	expectations.Report(std::cout);
+
+	return failed ? EXPECT_FAILED : EXPECT_OK;
+}
+
+static int RunProfile(const CommandLine &cmdline, const TrafficProfile &profile, ExpectProgram &expectations)
+{
+	DHCPSessionSocket sock;
+
+	// Dumping only needs the schedule, not the network.
+	if (cmdline.dump_schedule)
+	{
+		ProfileReplay replay(sock, profile, expectations);
+		replay.DumpSchedule(std::cout);
+		return EXIT_SUCCESS;
+	}
+
+	if (int res = sock.OpenInterface(cmdline.interface, profile.family); res)
+	{
+		std::cerr << "Failed to open a new socket: " << strerror(errno) << std::endl;
+		return EXPECT_ERROR;
+	}
+
+	bool bound = profile.family == AF_INET6 ? sock.BindSocket(in6addr_any, DHCPV6_CLIENT_PORT) : sock.BindSocket(INADDR_ANY, 68);
+	if (!bound)
+		return EXPECT_ERROR;
+
+	// Building the schedule and templates happens here, before the clock starts.
+	ProfileReplay replay(sock, profile, expectations);
+	return replay.Run(std::chrono::seconds(cmdline.timeout));
+}
+
 int main(int argc, char* argv[]) 
 {
 	CommandLine cmdline;
-	if (int ret = cmdline.Parse(argc, argv); ret != 0)
-		return ret;
+	if (auto ret = cmdline.Parse(argc, argv); ret)
+		return *ret;
+
+	// Traffic profiles say which protocol they speak.
+	std::optional<TrafficProfile> profile;
+	if (!cmdline.profile.empty())
+	{
+		profile = TrafficProfile::Load(cmdline.profile);
+		if (!profile)
+			return EXPECT_ERROR;
+		if (cmdline.seed)
+			profile->seed = cmdline.seed;
+	}
+
+	int family = profile ? profile->family : (cmdline.ipv6 ? AF_INET6 : AF_INET);
+
+	// Compile the expectations up front so a typo fails before we touch the network.
+	auto expectations = ExpectProgram::Compile(cmdline.expects, family);
+	if (!expectations)
+		return EXPECT_ERROR;
+
+	if (profile)
+		return RunProfile(cmdline, *profile, *expectations);
+
+	if (cmdline.ipv6)
+		return RunDHCPv6(cmdline, *expectations);
 
 	DHCPSessionSocket sock;
 	if (int res = sock.OpenInterface(cmdline.interface); res)
 	{
 		std::cerr << "Failed to open a new socket: " << strerror(errno) << std::endl;
-		return EXIT_FAILURE;
+		return EXPECT_ERROR;
 	}
 
 	// Bind to the interface address on port 68 (as client)
 	if (!sock.BindSocket(INADDR_ANY, 68))
 	{
 		perror("bind");
-		return EXIT_FAILURE;
+		return EXPECT_ERROR;
 	}
 
 	DHCPPayload payload;
@@ -175,13 +458,24 @@ int main(int argc, char* argv[])
 	memcpy(packet_->chaddr, sock.GetInterfaceHWID().data(), packet_->hlen);
 
 	payload.AddOption(53, cmdline.mtype);
-	
+
+	if (cmdline.monitor)
+	{
+		auto seconds = [](double secs) {
+			return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::duration<double>(secs));
+		};
+
+		DHCPMonitor monitor(sock, payload.GetStructureData(), *expectations,
+			seconds(cmdline.interval), seconds(cmdline.jitter), std::chrono::seconds(cmdline.timeout), cmdline.seed);
+		return monitor.Run();
+	}
+
 	// Send out the broadcast socket.
 	ssize_t written = sock.Send(INADDR_BROADCAST, 67, payload.GetStructureData());
 	if (written < 0)
 	{
 		std::cerr << "Failed to send datagram: " << strerror(errno) << std::endl;
-		return EXIT_FAILURE;
+		return EXPECT_ERROR;
 	}
 
 	std::cerr << "Wrote " << written << " bytes!" << std::endl;
@@ -190,65 +484,53 @@ int main(int argc, char* argv[])
 	// According to AI this is the average DHCP packet size.
 	buffer.reserve(579); 
 
-	ssize_t readdata = sock.Recieve(INADDR_BROADCAST, 68, buffer);
-	if (readdata < 0)
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(cmdline.timeout);
+	struct DHCPPacket *packet = nullptr;
+
+	while (!packet)
 	{
-		perror("recvfrom");
-		return EXIT_FAILURE;
+		auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+		if (!sock.SetReceiveTimeout(remaining))
+			return EXPECT_ERROR;
+
+		ssize_t readdata = sock.Recieve(INADDR_BROADCAST, 68, buffer);
+		if (readdata < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				std::cerr << "No reply received within " << cmdline.timeout << " seconds" << std::endl;
+				return EXPECT_NOREPLY;
+			}
+
+			perror("recvfrom");
+			return EXPECT_ERROR;
+		}
+
+		// Other clients may be talking to the server at the same time,
+		// ignore anything that isn't a reply to our transaction.
+		if (buffer.size() < sizeof(struct DHCPPacket))
+			continue;
+
+		struct DHCPPacket *reply = reinterpret_cast<struct DHCPPacket*>(buffer.data());
+		if (reply->op == BOOTREPLY && reply->xid == cmdline.xid)
+			packet = reply;
 	}
 
-	printf("Received %d bytes of data!\n", buffer.size());
+	printf("Received %zu bytes of data!\n", buffer.size());
 
 	print_xxd(buffer);
 
-	struct DHCPPacket *packet = reinterpret_cast<struct DHCPPacket*>(buffer.data());
-
-	printf("op: 0x%X\n", packet->op);
-	printf("htype: 0x%X\n", packet->htype);
-	printf("hlen: %d\n", packet->hlen);
-	printf("hops: %d\n", packet->hops);
-	printf("xid: 0x%X\n", packet->xid);
-	printf("secs: %d\n", packet->secs);
-	printf("flags: 0x%X\n", packet->flags);
-	printf("ciaddr: %s\n", IPv4ToString(packet->ciaddr).c_str());
-	printf("yiaddr: %s\n", IPv4ToString(packet->yiaddr).c_str());
-	printf("siaddr: %s\n", IPv4ToString(packet->siaddr).c_str());
-	printf("giaddr: %s\n", IPv4ToString(packet->giaddr).c_str());
-	printf("chaddr: ");
-	for (int i = 0; i < packet->hlen; ++i)
-		printf("%0X%c", packet->chaddr[i], (i + 1 == packet->hlen ? '\0' : ':'));
-	printf("\nsname: %s\n", packet->sname);
-	printf("file: %s\n", packet->file);
-	printf("cookie: 0x%X\n\nDHCP Options\n", packet->cookie);
-
-	// Process all the DHCP options.
-	std::vector<struct DHCPOption*> options;
-
-	// The DHCP option structures come after the initial DHCP packet header processed
-	// above. In this case we have to iterate rather carefully to find all the structures.
-	struct DHCPOption *optstart = reinterpret_cast<struct DHCPOption*>(packet + 1);
-
-	// Make sure this is not DHCP options end.
-	while (optstart->option_id != 0xFF)
-	{
-		// Start by getting the size of a structure (3 bytes)
-		// we subtract 1 because the compiler will assume that
-		// `uint8_t data[1]` is 1 byte but that is incorrect.
-		size_t len = sizeof(struct DHCPOption) - 1 + optstart->option_len;
-		// Sanity check
-		assert(len < buffer.size() && "length calculated to be longer than the buffer???");
-		// Next, we read the structure and figure out what additional
-		// length needs to be read/parsed. At this stage, we can also
-		// print the info to the console.
-		printf("Option %d: ", optstart->option_id);
-		for (int i = 0; i < optstart->option_len; ++i)
-			printf("%X", optstart->data[i]);
-		printf("\n");
+	bool valid = PrintDHCPPacket(stdout, buffer);
 
-		// Now move to the next one.
-		options.emplace_back(optstart);
-		optstart = reinterpret_cast<struct DHCPOption*>(reinterpret_cast<uint8_t*>(optstart) + len);
-	}
+	if (!valid)
+		std::cerr << "Reply contains a malformed option, ignoring the rest" << std::endl;
+
+	if (expectations->Empty())
+		return EXIT_SUCCESS;
+
+	printf("\nExpectations\n");
+	size_t failed = expectations->Evaluate(GetDHCPOptions(buffer));
+	expectations->Report(std::cout);
 
-	return EXIT_SUCCESS;
+	return failed ? EXPECT_FAILED : EXPECT_OK;
 }
@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <format>
+#include <iomanip>
+#include <iostream>
+#include <span>
+#include <time.h>
+
+#include "DHCP.h"
+#include "DHCPv6.h"
+#include "Monitor.h"
+
+// Cleared by the signal handler to stop the probe loop.
+static volatile sig_atomic_t running = 1;
+
+static void StopMonitor(int)
+{
+	running = 0;
+}
+
+// Prefix for every line we print so the output can be read as a log.
+static std::ostream &Log()
+{
+	std::time_t now = std::time(nullptr);
+	struct tm local;
+	localtime_r(&now, &local);
+	return std::cout << std::put_time(&local, "[%Y-%m-%d %H:%M:%S] ");
+}
+
+// FNV-1a, enough to notice that a server changed what it hands out.
+static uint64_t Fingerprint(uint64_t hash, uint16_t code, std::span<const uint8_t> data) noexcept
+{
+	auto mix = [&hash](uint8_t byte) {
+		hash ^= byte;
+		hash *= 0x100000001B3ULL;
+	};
+
+	mix(static_cast<uint8_t>(code >> 8));
+	mix(static_cast<uint8_t>(code));
+	mix(static_cast<uint8_t>(data.size() >> 8));
+	mix(static_cast<uint8_t>(data.size()));
+	for (uint8_t byte : data)
+		mix(byte);
+	return hash;
+}
+
+DHCPMonitor::DHCPMonitor(DHCPSessionSocket &sock, std::vector<uint8_t> &&request, ExpectProgram &expectations,
+	std::chrono::microseconds interval, std::chrono::microseconds jitter, std::chrono::microseconds timeout,
+	uint64_t seed) :
+	sock_(sock), template_(std::move(request)), expectations_(expectations),
+	interval_(interval), jitter_(jitter), timeout_(timeout),
+	gen_(seed ? static_cast<std::mt19937::result_type>(seed) : std::random_device{}())
+{
+	this->buffer_.reserve(1024);
+}
+
+MonitorServer &DHCPMonitor::FindServer(std::string &&name)
+{
+	auto it = std::ranges::find(this->servers_, name, &MonitorServer::name);
+	if (it != this->servers_.end())
+		return *it;
+
+	Log() << "New server " << name << " is answering" << std::endl;
+	MonitorServer &server = this->servers_.emplace_back();
+	server.name = std::move(name);
+	return server;
+}
+
+void DHCPMonitor::PrintStatistics(const MonitorServer &server) const
+{
+	size_t answered = 0;
+	for (size_t i = 0; i < server.answered.Size(); ++i)
+		answered += server.answered[i];
+
+	std::cout << server.name << ": "
+		<< answered << "/" << server.answered.Size() << " answered";
+
+	if (server.latency.Empty())
+	{
+		std::cout << std::endl;
+		return;
+	}
+
+	// Compare the newer half of the window against the older half to show
+	// which way latency is heading.
+	std::chrono::microseconds min = server.latency[0], max = min, total{0}, older{0}, newer{0};
+	size_t half = server.latency.Size() / 2;
+	for (size_t i = 0; i < server.latency.Size(); ++i)
+	{
+		auto sample = server.latency[i];
+		min = std::min(min, sample);
+		max = std::max(max, sample);
+		total += sample;
+		(i < half ? older : newer) += sample;
+	}
+
+	auto ms = [](std::chrono::microseconds us) { return static_cast<double>(us.count()) / 1000.0; };
+	auto size = static_cast<std::chrono::microseconds::rep>(server.latency.Size());
+
+	std::cout << std::fixed << std::setprecision(2)
+		<< ", last " << ms(server.latency.Back()) << "ms"
+		<< ", min/avg/max " << ms(min) << "/" << ms(total / size) << "/" << ms(max) << "ms";
+
+	if (half)
+	{
+		auto trend = newer / static_cast<std::chrono::microseconds::rep>(server.latency.Size() - half)
+			- older / static_cast<std::chrono::microseconds::rep>(half);
+		std::cout << ", trend " << std::showpos << ms(trend) << std::noshowpos << "ms";
+	}
+
+	std::cout << std::endl;
+}
+
+void DHCPMonitor::HandleReply(std::chrono::microseconds latency)
+{
+	bool v6 = this->sock_.GetFamily() == AF_INET6;
+	in_addr_t address = v6 ? 0 : reinterpret_cast<const struct DHCPPacket*>(this->buffer_.data())->siaddr;
+	std::span<const uint8_t> duid;
+	uint64_t fingerprint = 0xCBF29CE484222325ULL;
+
+	// One pass over the options does everything: find the server
+	// identifier, fingerprint the reply and check the expectations.
+	auto visit = [&](uint16_t code, std::span<const uint8_t> data) {
+		if (!v6 && code == 54 && data.size() == sizeof(in_addr_t))
+			memcpy(&address, data.data(), sizeof(in_addr_t));
+		else if (v6 && code == OPTION_SERVERID)
+			duid = data;
+		fingerprint = Fingerprint(fingerprint, code, data);
+		this->expectations_.OnOption(code, data);
+	};
+
+	this->expectations_.Begin();
+	bool valid = v6 ? WalkNestedDHCPv6Options(GetDHCPv6Options(this->buffer_), visit)
+		: WalkLongDHCPOptions(GetDHCPOptions(this->buffer_), this->scratch_, visit);
+
+	std::string name;
+	if (!v6)
+		name = IPv4ToString(address);
+	else
+		for (uint8_t byte : duid)
+			name += std::format("{:02x}", byte);
+
+	MonitorServer &server = this->FindServer(std::move(name));
+
+	// A server may answer more than once, only count the first.
+	if (server.last_probe == this->probes_)
+		return;
+
+	server.last_probe = this->probes_;
+	server.answered.Push(true);
+	server.latency.Push(latency);
+
+	if (!server.up)
+	{
+		Log() << "RECOVERED: " << server.name << " is answering again" << std::endl;
+		server.up = true;
+	}
+
+	if (!valid)
+	{
+		Log() << "ALERT: " << server.name << " sent malformed options" << std::endl;
+		return;
+	}
+
+	if (server.fingerprint && server.fingerprint != fingerprint)
+		Log() << "ALERT: " << server.name << " changed the options it hands out" << std::endl;
+	server.fingerprint = fingerprint;
+
+	if (this->expectations_.Empty())
+		return;
+
+	bool passing = this->expectations_.Finish() == 0;
+	if (!passing && server.passing)
+	{
+		Log() << "ALERT: " << server.name << " failed expectations" << std::endl;
+		this->expectations_.Report(std::cout, true);
+	}
+	else if (passing && !server.passing)
+		Log() << "RECOVERED: " << server.name << " meets expectations again" << std::endl;
+	server.passing = passing;
+}
+
+bool DHCPMonitor::Probe()
+{
+	bool v6 = this->sock_.GetFamily() == AF_INET6;
+
+	// Only the transaction id changes between probes.
+	uint32_t xid;
+	if (v6)
+	{
+		xid = std::uniform_int_distribution<uint32_t>(1, 0xFFFFFF)(this->gen_);
+		SetDHCPv6TransactionID(reinterpret_cast<struct DHCPv6Packet*>(this->template_.data()), xid);
+	}
+	else
+	{
+		xid = std::uniform_int_distribution<uint32_t>(1)(this->gen_);
+		memcpy(this->template_.data() + offsetof(struct DHCPPacket, xid), &xid, sizeof(xid));
+	}
+	++this->probes_;
+
+	auto sent = std::chrono::steady_clock::now();
+	ssize_t written = v6 ? this->sock_.Send(DHCPV6_ALL_SERVERS, DHCPV6_SERVER_PORT, this->template_)
+		: this->sock_.Send(INADDR_BROADCAST, 67, this->template_);
+	if (written < 0)
+	{
+		Log() << "Failed to send probe: " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	// Keep listening for the whole timeout, there may be more than one server.
+	bool answered = false;
+	auto deadline = sent + this->timeout_;
+	while (running)
+	{
+		auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+		if (remaining.count() <= 0 || !this->sock_.SetReceiveTimeout(remaining))
+			break;
+
+		if (this->sock_.Recieve(INADDR_BROADCAST, 68, this->buffer_) < 0)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				perror("recvfrom");
+			break;
+		}
+
+		if (v6)
+		{
+			if (this->buffer_.size() < sizeof(struct DHCPv6Packet))
+				continue;
+
+			const struct DHCPv6Packet *reply = reinterpret_cast<const struct DHCPv6Packet*>(this->buffer_.data());
+			if ((reply->msg_type != DHCPV6_ADVERTISE && reply->msg_type != DHCPV6_REPLY) || GetDHCPv6TransactionID(reply) != xid)
+				continue;
+		}
+		else
+		{
+			if (this->buffer_.size() < sizeof(struct DHCPPacket))
+				continue;
+
+			const struct DHCPPacket *reply = reinterpret_cast<const struct DHCPPacket*>(this->buffer_.data());
+			if (reply->op != BOOTREPLY || reply->xid != xid)
+				continue;
+		}
+
+		answered = true;
+		this->HandleReply(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sent));
+	}
+
+	// Anyone we've heard from before who stayed quiet this time missed the probe.
+	for (MonitorServer &server : this->servers_)
+	{
+		if (server.last_probe == this->probes_)
+			continue;
+
+		server.answered.Push(false);
+		if (server.up)
+		{
+			Log() << "ALERT: " << server.name << " did not answer" << std::endl;
+			server.up = false;
+		}
+	}
+
+	if (!answered && this->answered_)
+		Log() << "ALERT: no reply within " << this->timeout_.count() / 1000 << "ms" << std::endl;
+	else if (answered && !this->answered_)
+		Log() << "RECOVERED: replies are arriving again" << std::endl;
+	this->answered_ = answered;
+
+	return answered;
+}
+
+int DHCPMonitor::Run()
+{
+	// No SA_RESTART, we want sleeps and receives to be interrupted.
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = StopMonitor;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, nullptr);
+	sigaction(SIGTERM, &sa, nullptr);
+
+	std::uniform_int_distribution<std::chrono::microseconds::rep> jitter(0, this->jitter_.count());
+	auto next = std::chrono::steady_clock::now();
+
+	Log() << "Monitoring on " << this->sock_.GetInterface() << " every "
+		<< this->interval_.count() / 1000 << "ms" << std::endl;
+
+	while (running)
+	{
+		this->Probe();
+
+		for (const MonitorServer &server : this->servers_)
+		{
+			Log() << "probe " << this->probes_ << " ";
+			this->PrintStatistics(server);
+		}
+
+		// Schedule off the previous probe rather than now so we don't drift,
+		// but never try to catch up on probes we missed.
+		next = std::max(next + this->interval_, std::chrono::steady_clock::now());
+		auto wake = next + std::chrono::microseconds(jitter(this->gen_));
+
+		auto since = std::chrono::duration_cast<std::chrono::nanoseconds>(wake.time_since_epoch());
+		struct timespec ts;
+		ts.tv_sec = static_cast<time_t>(since.count() / 1000000000);
+		ts.tv_nsec = static_cast<long>(since.count() % 1000000000);
+		while (running && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+			;
+	}
+
+	Log() << "Stopping after " << this->probes_ << " probes" << std::endl;
+	for (const MonitorServer &server : this->servers_)
+		this->PrintStatistics(server);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,522 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <format>
+#include <map>
+#include <numbers>
+#include <random>
+#include <string_view>
+#include <time.h>
+
+#include "DHCP.h"
+#include "DHCPv6.h"
+#include "Parse.h"
+#include "Profile.h"
+
+// How close to a send we stop sleeping and spin on the clock instead.
+#define PROFILE_SPIN_NS 50000
+
+// Replies are matched to messages by xid, and DHCPv6 xids are only 24
+// bits wide. Every message also costs 32 bytes of schedule and timing, so
+// this caps what is allocated before the first send at about 512MB.
+#define PROFILE_MAX_EVENTS 0xFFFFFF
+
+// Only messages a server answers without any earlier state, so every
+// message sent counts towards the reply rate. Requests, renews and the like
+// need a lease from an earlier exchange and releases are never answered.
+static const std::map<std::string_view, uint8_t> messages4{
+	{"discover", DHCPDISCOVER},
+	{"inform", DHCPINFORM}
+};
+
+static const std::map<std::string_view, uint8_t> messages6{
+	{"solicit", DHCPV6_SOLICIT},
+	{"inform", DHCPV6_INFORMATION_REQUEST}
+};
+
+static uint64_t Now() noexcept
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+std::optional<TrafficProfile> TrafficProfile::Load(const std::string &path)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		std::cerr << "Failed to open profile " << path << ": " << strerror(errno) << std::endl;
+		return std::nullopt;
+	}
+
+	TrafficProfile profile;
+	size_t lineno = 0;
+	auto error = [&path, &lineno](std::string_view message) {
+		std::cerr << path << (lineno ? ":" + std::to_string(lineno) : "") << ": " << message << std::endl;
+		return std::nullopt;
+	};
+
+	// Message names and option codes depend on the protocol, which may come
+	// later in the file, so these are resolved once everything is read.
+	std::vector<std::pair<std::string, uint32_t>> mix;
+	std::vector<std::pair<uint32_t, std::vector<uint8_t>>> options;
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		++lineno;
+		std::string_view text = line;
+		text = Trim(text.substr(0, text.find('#')));
+		if (text.empty())
+			continue;
+
+		size_t equals = text.find('=');
+		if (equals == std::string_view::npos)
+			return error("expected key = value");
+
+		std::string_view key = Trim(text.substr(0, equals)), value = Trim(text.substr(equals + 1));
+
+		if (key == "seed")
+		{
+			auto seed = ParseNumber<uint64_t>(value);
+			if (!seed)
+				return error("seed must be a number");
+			profile.seed = *seed;
+		}
+		else if (key == "protocol")
+		{
+			if (value != "4" && value != "6")
+				return error("protocol must be 4 or 6");
+			profile.family = value == "6" ? AF_INET6 : AF_INET;
+		}
+		else if (key == "clients")
+		{
+			auto clients = ParseNumber<uint32_t>(value);
+			if (!clients || *clients == 0)
+				return error("clients must be at least 1");
+			profile.clients = *clients;
+		}
+		else if (key == "mac")
+		{
+			if (value.size() != 17)
+				return error("mac must look like 02:00:00:00:00:00");
+			for (size_t i = 0; i < profile.mac.size(); ++i)
+			{
+				auto byte = ParseNumber<uint8_t>(value.substr(i * 3, 2), 16);
+				if (!byte || (i < 5 && value[i * 3 + 2] != ':'))
+					return error("mac must look like 02:00:00:00:00:00");
+				profile.mac[i] = *byte;
+			}
+		}
+		else if (key == "duration" || key == "rate" || key == "peak" || key == "period" || key == "burst")
+		{
+			auto number = ParseNumber<double>(value);
+			if (!number || !std::isfinite(*number) || *number < 0)
+				return error("expected a positive number");
+
+			if (key == "duration")
+				profile.duration = *number;
+			else if (key == "rate")
+				profile.rate = *number;
+			else if (key == "peak")
+				profile.peak = *number;
+			else if (key == "period")
+				profile.period = *number;
+			else
+				profile.burst = *number;
+		}
+		else if (key == "curve")
+		{
+			if (value == "constant")
+				profile.curve = ProfileCurve::CONSTANT;
+			else if (value == "burst")
+				profile.curve = ProfileCurve::BURST;
+			else if (value == "diurnal")
+				profile.curve = ProfileCurve::DIURNAL;
+			else
+				return error("curve must be constant, burst or diurnal");
+		}
+		else if (key == "mix")
+		{
+			// Entries are name:weight separated by spaces or commas.
+			while (!(value = Trim(value)).empty())
+			{
+				size_t end = std::min(value.find_first_of(" \t,"), value.size());
+				std::string_view entry = value.substr(0, end);
+				value.remove_prefix(std::min(end + 1, value.size()));
+
+				size_t colon = entry.find(':');
+				auto weight = colon == std::string_view::npos ? std::optional<uint32_t>(1) : ParseNumber<uint32_t>(entry.substr(colon + 1));
+				if (!weight)
+					return error("mix entries look like discover:70");
+				mix.emplace_back(std::string(entry.substr(0, colon)), *weight);
+			}
+		}
+		else if (key == "option")
+		{
+			// Same format as -X, code=hexbytes.
+			size_t split = value.find('=');
+			auto code = ParseNumber<uint32_t>(Trim(value.substr(0, std::min(split, value.size()))));
+			std::string_view hex = split == std::string_view::npos ? "" : Trim(value.substr(split + 1));
+			if (!code)
+				return error("option must look like 60=6d736674");
+
+			std::vector<uint8_t> data;
+			if (!ParseHex(hex, data))
+				return error("option data must be hex");
+			options.emplace_back(*code, std::move(data));
+		}
+		else
+			return error("unknown key \"" + std::string(key) + "\"");
+	}
+
+	// Anything left is checked against the whole profile.
+	lineno = 0;
+	bool v6 = profile.family == AF_INET6;
+	const auto &names = v6 ? messages6 : messages4;
+
+	if (mix.empty())
+		mix.emplace_back(v6 ? "solicit" : "discover", 1);
+
+	uint64_t total = 0;
+	for (const auto &[name, weight] : mix)
+	{
+		auto it = names.find(name);
+		if (it == names.end())
+			return error("mix can only hold " + std::string(v6 ? "solicit" : "discover") + " and inform, not \"" + name + "\"");
+		profile.mix.emplace_back(it->second, weight);
+		total += weight;
+	}
+
+	if (total == 0)
+		return error("mix weights add up to zero");
+
+	for (auto &[code, data] : options)
+	{
+		if (code > (v6 ? 0xFFFFu : 0xFEu) || code == 0)
+			return error("option code " + std::to_string(code) + " is out of range");
+		profile.options.emplace_back(static_cast<uint16_t>(code), std::move(data));
+	}
+
+	if (profile.duration <= 0 || profile.period <= 0)
+		return error("duration and period must be more than zero");
+
+	if (std::max(profile.rate, profile.peak) <= 0)
+		return error("rate or peak must be more than zero");
+
+	// Without a peak a burst would silence traffic and diurnal would fade to nothing.
+	if (profile.curve != ProfileCurve::CONSTANT && profile.peak <= 0)
+		return error("burst and diurnal curves need a peak more than zero");
+
+	if (profile.curve == ProfileCurve::BURST && profile.burst > profile.period)
+		return error("burst must not be longer than period");
+
+	if (std::max(profile.rate, profile.peak) * profile.duration > PROFILE_MAX_EVENTS)
+		return error("profile would send more than " + std::to_string(PROFILE_MAX_EVENTS) + " messages");
+
+	return profile;
+}
+
+double TrafficProfile::RateAt(double seconds) const noexcept
+{
+	switch (this->curve)
+	{
+		case ProfileCurve::BURST:
+			return std::fmod(seconds, this->period) < this->burst ? this->peak : this->rate;
+		case ProfileCurve::DIURNAL:
+			// Start in the trough and reach the peak half way through the period.
+			return this->rate + (this->peak - this->rate) * (1 - std::cos(2 * std::numbers::pi * seconds / this->period)) / 2;
+		case ProfileCurve::CONSTANT:
+		default:
+			return this->rate;
+	}
+}
+
+std::array<uint8_t, 6> TrafficProfile::ClientMAC(uint32_t client) const noexcept
+{
+	uint64_t address = 0;
+	for (uint8_t byte : this->mac)
+		address = address << 8 | byte;
+
+	address += client;
+
+	std::array<uint8_t, 6> result;
+	for (size_t i = result.size(); i-- > 0; address >>= 8)
+		result[i] = static_cast<uint8_t>(address);
+	return result;
+}
+
+uint32_t TrafficProfile::BaseTransactionID() const noexcept
+{
+	// mt19937_64's output is fixed by the standard, unlike the distributions,
+	// so this is the same on every platform and standard library.
+	return static_cast<uint32_t>(std::mt19937_64(this->seed)() >> 32);
+}
+
+std::vector<ProfileEvent> TrafficProfile::BuildSchedule() const
+{
+	std::mt19937_64 gen(this->seed);
+	// The first value is the base transaction id.
+	gen.discard(1);
+
+	uint64_t total = 0;
+	for (const auto &[type, weight] : this->mix)
+		total += weight;
+
+	std::vector<ProfileEvent> schedule;
+	schedule.reserve(static_cast<size_t>(std::max(this->rate, this->peak) * this->duration) + 1);
+
+	// Arrivals follow the integral of the rate curve rather than being drawn
+	// at random, so the same profile always gives the same offsets. The curve
+	// is integrated in 1ms slices with the rate held at the slice's midpoint.
+	const double slice = 0.001;
+	double owed = 0;
+	uint64_t slices = static_cast<uint64_t>(std::ceil(this->duration / slice));
+	for (uint64_t n = 0; n < slices; ++n)
+	{
+		double start = static_cast<double>(n) * slice;
+		double current = this->RateAt(start + slice / 2);
+		if (current <= 0)
+			continue;
+
+		// `owed` is how far we are towards the next arrival.
+		double arrivals = owed + current * slice;
+		for (double k = 1; k <= arrivals; ++k)
+		{
+			double seconds = start + (k - owed) / current;
+			if (seconds >= this->duration)
+				break;
+
+			ProfileEvent event;
+			event.offset = static_cast<uint64_t>(std::llround(seconds * 1e9));
+			event.client = static_cast<uint32_t>(gen() % this->clients);
+
+			uint64_t pick = gen() % total;
+			event.message = 0;
+			while (pick >= this->mix[event.message].second)
+				pick -= this->mix[event.message++].second;
+
+			schedule.emplace_back(event);
+		}
+		owed = arrivals - std::floor(arrivals);
+	}
+
+	return schedule;
+}
+
+ProfileReplay::ProfileReplay(DHCPSessionSocket &sock, const TrafficProfile &profile, ExpectProgram &expectations) :
+	sock_(sock), profile_(profile), expectations_(expectations), schedule_(profile.BuildSchedule())
+{
+	this->BuildTemplates();
+	this->sent_.resize(this->schedule_.size());
+	this->latency_.resize(this->schedule_.size());
+	this->buffer_.reserve(1024);
+}
+
+void ProfileReplay::BuildTemplates()
+{
+	for (const auto &[type, weight] : this->profile_.mix)
+	{
+		if (this->profile_.family == AF_INET6)
+		{
+			DHCPv6Payload payload(static_cast<DHCPv6MessageType>(type), 0);
+			payload.AddOption(OPTION_CLIENTID, DHCPv6DUIDLL(this->profile_.mac));
+			payload.AddOption(OPTION_ELAPSED_TIME, std::array<uint8_t, 2>{0, 0});
+			if (type == DHCPV6_SOLICIT)
+				payload.AddOption(OPTION_IA_NA, DHCPv6IA(1));
+
+			for (const auto &[code, data] : this->profile_.options)
+				payload.AddOption(code, data);
+
+			this->templates_.emplace_back(std::move(payload.GetStructureData()));
+		}
+		else
+		{
+			DHCPPayload payload;
+			struct DHCPPacket *packet = payload.GetDHCPPakcetStructure();
+			packet->hlen  = 6;
+			packet->flags = htons(0x8000); // broadcast bit set
+
+			// An inform comes from a client which already has an address.
+			if (type == DHCPINFORM)
+				packet->ciaddr = this->sock_.GetInterfaceAddress();
+
+			payload.AddOption(53, type);
+			for (const auto &[code, data] : this->profile_.options)
+				payload.AddOption(static_cast<uint8_t>(code), data);
+
+			this->templates_.emplace_back(std::move(payload.GetStructureData()));
+		}
+	}
+
+	// The client id is the first DHCPv6 option: skip its code and length,
+	// then the DUID type and hardware type to reach the MAC address.
+	if (this->profile_.family == AF_INET6)
+		this->mac_offset_ = sizeof(struct DHCPv6Packet) + 4 + 4;
+	else
+		this->mac_offset_ = offsetof(struct DHCPPacket, chaddr);
+}
+
+void ProfileReplay::HandleReply(uint64_t now)
+{
+	uint32_t base = this->profile_.BaseTransactionID();
+	size_t idx;
+
+	if (this->profile_.family == AF_INET6)
+	{
+		if (this->buffer_.size() < sizeof(struct DHCPv6Packet))
+			return;
+
+		const struct DHCPv6Packet *reply = reinterpret_cast<const struct DHCPv6Packet*>(this->buffer_.data());
+		if (reply->msg_type != DHCPV6_ADVERTISE && reply->msg_type != DHCPV6_REPLY)
+			return;
+		idx = (GetDHCPv6TransactionID(reply) - base) & 0xFFFFFF;
+	}
+	else
+	{
+		if (this->buffer_.size() < sizeof(struct DHCPPacket))
+			return;
+
+		const struct DHCPPacket *reply = reinterpret_cast<const struct DHCPPacket*>(this->buffer_.data());
+		if (reply->op != BOOTREPLY)
+			return;
+		idx = reply->xid - base;
+	}
+
+	// Ignore anything that isn't ours, and all but the first reply to each message.
+	if (idx >= this->schedule_.size() || !this->sent_[idx] || this->latency_[idx])
+		return;
+
+	this->latency_[idx] = std::max<uint64_t>(now - this->sent_[idx], 1);
+
+	if (this->expectations_.Empty())
+		return;
+
+	size_t failed = this->profile_.family == AF_INET6
+		? this->expectations_.EvaluateV6(GetDHCPv6Options(this->buffer_))
+		: this->expectations_.Evaluate(GetDHCPOptions(this->buffer_));
+	if (failed)
+		++this->expectation_failures_;
+}
+
+void ProfileReplay::Drain(int flags)
+{
+	while (this->sock_.Recieve(INADDR_ANY, 0, this->buffer_, flags) >= 0)
+		this->HandleReply(Now());
+}
+
+void ProfileReplay::DumpSchedule(std::ostream &out) const
+{
+	bool v6 = this->profile_.family == AF_INET6;
+	uint32_t base = this->profile_.BaseTransactionID();
+
+	out << "index,offset_ns,client,mac,message,xid\n";
+	for (size_t i = 0; i < this->schedule_.size(); ++i)
+	{
+		const ProfileEvent &event = this->schedule_[i];
+		auto mac = this->profile_.ClientMAC(event.client);
+		uint32_t xid = base + static_cast<uint32_t>(i);
+
+		out << std::format("{},{},{},{:02x}:{:02x}:{:02x}:{:02x}:{:02x}:{:02x},{},0x{:x}\n",
+			i, event.offset, event.client, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5],
+			this->profile_.mix[event.message].first, v6 ? xid & 0xFFFFFF : xid);
+	}
+}
+
+int ProfileReplay::Run(std::chrono::seconds timeout)
+{
+	bool v6 = this->profile_.family == AF_INET6;
+	uint32_t base = this->profile_.BaseTransactionID();
+
+	std::cerr << "Replaying " << this->schedule_.size() << " messages over "
+		<< this->profile_.duration << " seconds (seed " << this->profile_.seed << ")" << std::endl;
+
+	uint64_t start = Now();
+	for (size_t i = 0; i < this->schedule_.size(); ++i)
+	{
+		const ProfileEvent &event = this->schedule_[i];
+		uint64_t target = start + event.offset;
+
+		// Pick up replies while we wait, then spin for the last stretch
+		// since sleeping is only accurate to tens of microseconds.
+		for (uint64_t now = Now(); now < target; now = Now())
+		{
+			if (target - now > PROFILE_SPIN_NS && this->sock_.WaitReadable(std::chrono::nanoseconds(target - now - PROFILE_SPIN_NS)))
+				this->Drain(MSG_DONTWAIT);
+		}
+
+		std::vector<uint8_t> &message = this->templates_[event.message];
+		uint32_t xid = base + static_cast<uint32_t>(i);
+		if (v6)
+			SetDHCPv6TransactionID(reinterpret_cast<struct DHCPv6Packet*>(message.data()), xid & 0xFFFFFF);
+		else
+			memcpy(message.data() + offsetof(struct DHCPPacket, xid), &xid, sizeof(xid));
+
+		auto mac = this->profile_.ClientMAC(event.client);
+		memcpy(message.data() + this->mac_offset_, mac.data(), mac.size());
+
+		uint64_t sent = Now();
+		ssize_t written = v6 ? this->sock_.Send(DHCPV6_ALL_SERVERS, DHCPV6_SERVER_PORT, message)
+			: this->sock_.Send(INADDR_BROADCAST, 67, message);
+		if (written < 0)
+		{
+			++this->send_errors_;
+			continue;
+		}
+
+		this->sent_[i] = sent;
+		this->lateness_total_ += sent - target;
+		this->lateness_max_ = std::max(this->lateness_max_, sent - target);
+	}
+
+	uint64_t finished = Now();
+
+	// Give the server until the timeout to answer the stragglers.
+	uint64_t deadline = finished + static_cast<uint64_t>(std::chrono::nanoseconds(timeout).count());
+	for (uint64_t now = Now(); now < deadline; now = Now())
+		if (this->sock_.WaitReadable(std::chrono::nanoseconds(deadline - now)))
+			this->Drain(MSG_DONTWAIT);
+
+	std::vector<uint64_t> latencies;
+	for (uint64_t latency : this->latency_)
+		if (latency)
+			latencies.emplace_back(latency);
+	std::ranges::sort(latencies);
+
+	size_t sent = this->schedule_.size() - this->send_errors_;
+	double elapsed = static_cast<double>(finished - start) / 1e9;
+	auto ms = [](uint64_t ns) { return static_cast<double>(ns) / 1e6; };
+	auto percentile = [&latencies](double p) {
+		return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * static_cast<double>(latencies.size())))];
+	};
+
+	printf("Sent %zu of %zu messages in %.3fs (%.1f/s), %zu send errors\n", sent, this->schedule_.size(),
+		elapsed, elapsed > 0 ? static_cast<double>(sent) / elapsed : 0.0, this->send_errors_);
+	printf("Pacing: mean %.3fms, max %.3fms behind schedule\n",
+		sent ? ms(this->lateness_total_) / static_cast<double>(sent) : 0.0, ms(this->lateness_max_));
+	printf("Replies: %zu (%.1f%%)\n", latencies.size(), sent ? 100.0 * static_cast<double>(latencies.size()) / static_cast<double>(sent) : 0.0);
+
+	if (!latencies.empty())
+		printf("Latency: p50 %.3fms, p90 %.3fms, p99 %.3fms, max %.3fms\n",
+			ms(percentile(0.50)), ms(percentile(0.90)), ms(percentile(0.99)), ms(latencies.back()));
+
+	if (!this->expectations_.Empty())
+		printf("Expectation failures: %zu\n", this->expectation_failures_);
+
+	// A run that couldn't send its whole schedule didn't apply the load the
+	// profile describes, so its numbers can't be trusted either way.
+	if (this->send_errors_)
+	{
+		std::cerr << "Failed to send " << this->send_errors_ << " messages" << std::endl;
+		return EXPECT_ERROR;
+	}
+
+	if (sent && latencies.empty())
+		return EXPECT_NOREPLY;
+
+	return this->expectation_failures_ ? EXPECT_FAILED : EXPECT_OK;
+}
@@ -11,6 +11,8 @@
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/time.h>
+#include <poll.h>
 #include <net/if.h>
 #include <iostream>
 #include "Socket.h"
@@ -27,15 +29,49 @@ bool DHCPSessionSocket::SetSocketOption(int option, bool state)
 	return true;
 }
 
-int DHCPSessionSocket::OpenInterface(std::string iface)
+bool DHCPSessionSocket::SetReceiveTimeout(std::chrono::microseconds timeout)
 {
-	this->sock_ = socket(AF_INET, SOCK_DGRAM, 0);
+	// A zero timeval means block forever, so round up to the smallest wait.
+	if (timeout.count() <= 0)
+		timeout = std::chrono::microseconds(1);
+
+	struct timeval tv;
+	tv.tv_sec = static_cast<time_t>(timeout.count() / 1000000);
+	tv.tv_usec = static_cast<suseconds_t>(timeout.count() % 1000000);
+
+	if (setsockopt(this->sock_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
+	{
+		perror("setsockopt");
+		return false;
+	}
+	return true;
+}
+
+bool DHCPSessionSocket::WaitReadable(std::chrono::nanoseconds timeout)
+{
+	struct pollfd pfd;
+	pfd.fd = this->sock_;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	// ppoll takes a timespec, which keeps the nanosecond resolution.
+	struct timespec ts;
+	ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+	ts.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+
+	return ppoll(&pfd, 1, &ts, nullptr) > 0 && (pfd.revents & POLLIN);
+}
+
+int DHCPSessionSocket::OpenInterface(std::string iface, int family)
+{
+	this->family_ = family;
+	this->sock_ = socket(family, SOCK_DGRAM, 0);
 	if (sock_ == -1)
 		return errno;
 
 	// Set that we're a broadcast socket capable of sending to 
-	// 255.255.255.255 and such
-	if (!this->SetSocketOption(SO_BROADCAST, true))
+	// 255.255.255.255 and such, DHCPv6 uses multicast instead.
+	if (family == AF_INET && !this->SetSocketOption(SO_BROADCAST, true))
 	{
 		std::cerr << "Failed to set the socket to a broadcast IP capable socket" << std::endl;
 		return errno;
@@ -44,6 +80,14 @@ int DHCPSessionSocket::OpenInterface(std::string iface)
 	// Move our interface name copy into ourselves
 	this->interface_ = std::move(iface);
 
+	// DHCPv6 sends to link-local multicast which is scoped by interface index.
+	this->ifindex_ = if_nametoindex(this->interface_.c_str());
+	if (this->ifindex_ == 0)
+	{
+		std::cerr << "Failed to find interface " << this->interface_ << ": " << strerror(errno) << std::endl;
+		return errno;
+	}
+
 	// Get the interface mac address
 	struct ifreq ifr;
 	strcpy(ifr.ifr_name, this->interface_.c_str());
@@ -63,6 +107,12 @@ int DHCPSessionSocket::OpenInterface(std::string iface)
 		return errno;
 	}
 
+	// DHCPv6 clients always talk from their link-local address, which the
+	// kernel picks for us, so there is no address to look up.
+	this->interface_ip_ = 0;
+	if (family == AF_INET6)
+		return 0;
+
 	// Get the interface IP address if available
 	struct ifreq ifaceip;
 	strcpy(ifaceip.ifr_name, ifr.ifr_name);
@@ -95,6 +145,24 @@ bool DHCPSessionSocket::BindSocket(in_addr_t ipaddr, in_port_t port)
 	return true;
 }
 
+bool DHCPSessionSocket::BindSocket(const struct in6_addr &ipaddr, in_port_t port)
+{
+	sockaddrs bindable;
+	memset(&bindable, 0, sizeof(bindable));
+	bindable.in6.sin6_family = AF_INET6;
+	bindable.in6.sin6_port = htons(port);
+	bindable.in6.sin6_addr = ipaddr;
+	bindable.in6.sin6_scope_id = this->ifindex_;
+
+	if (int res = bind(this->sock_, &bindable.sa, sizeof(struct sockaddr_in6)); res)
+	{
+		perror("bind");
+		return false;
+	}
+
+	return true;
+}
+
 bool DHCPSessionSocket::BindSocket(std::string_view bindaddr, in_port_t port)
 {
 	auto address = ToIPv4(bindaddr);
@@ -105,14 +173,14 @@ bool DHCPSessionSocket::BindSocket(std::string_view bindaddr, in_port_t port)
 }
 
 
-ssize_t DHCPSessionSocket::Recieve(in_addr_t ipaddr, in_port_t port, std::vector<uint8_t> &buf)
+ssize_t DHCPSessionSocket::Recieve(in_addr_t ipaddr, in_port_t port, std::vector<uint8_t> &buf, int flags)
 {
 	// Sockaddr to know who we received data from
 	sockaddrs sa;
-	socklen_t slen = sizeof(struct sockaddr_in);
+	socklen_t slen = sizeof(sockaddrs);
 	buf.resize(1024);
 
-	ssize_t datasz = recvfrom(this->sock_, buf.data(), buf.capacity(), 0, &sa.sa, &slen);
+	ssize_t datasz = recvfrom(this->sock_, buf.data(), buf.capacity(), flags, &sa.sa, &slen);
 
 	if (datasz < 0)
 		return datasz;
@@ -124,7 +192,7 @@ ssize_t DHCPSessionSocket::Recieve(in_addr_t ipaddr, in_port_t port, std::vector
 	{
 		// Expand the buffer and re-read data.
 		buf.resize(buf.capacity()*2);
-		ssize_t moredatasz = recvfrom(this->sock_, buf.data()+datasz, buf.capacity(), 0, &sa.sa, &slen);
+		ssize_t moredatasz = recvfrom(this->sock_, buf.data()+datasz, buf.capacity(), flags, &sa.sa, &slen);
 		if (moredatasz < 0)
 			return moredatasz;
 